@@ -8,7 +8,17 @@
 #include "board-peripherals.h"
 #include "coap-engine.h"
 #include "coap.h"
-#include "sys/energest.h"
+#include "rep-cache.h"
+#include "cbor.h"
+#include "farm-frame.h"
+#include "report-policy.h"
+#include "backlog.h"
+#include "wake.h"
+#include "node-config.h"
+#include "energy.h"
+#include "proc-stats.h"
+#include "trace.h"
+#include "ezo.h"
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -38,7 +48,8 @@
 #define UDP_CLIENT_PORT   8769
 #define UDP_SERVER_PORT   5678
 
-#define SEND_INTERVAL     (5 * 60 * CLOCK_SECOND)
+/* Default, /config can change it */
+#define SAMPLE_INTERVAL   (60 * CLOCK_SECOND)
 
 static struct simple_udp_connection udp_conn;
 static uint32_t rx_count = 0;
@@ -51,97 +62,43 @@ extern coap_resource_t res_ecsensor;
 
 #define EC_SENSOR_I2C_ADDR        0x64
 
-#if CONTIKI_BOARD_SENSORTAG_CC1352R1
-typedef struct {
-  uint8_t data1;
-  uint8_t data2;
-  uint8_t data3;
-  uint8_t data4;
-  uint8_t data5;
-  uint8_t data6;
-  uint8_t data7;
-  uint8_t data8;
-  uint8_t data9;
-  uint8_t data10;
-  uint8_t data11;
-  uint8_t data12;
-  uint8_t data13;
-  uint8_t data14;
-  uint8_t data15;
-  uint8_t data16;
-  uint8_t data17;
-  uint8_t data18;
-  uint8_t data19;
-  uint8_t data20;
-  uint8_t data21;
-  uint8_t data22;
-  uint8_t data23;
-  uint8_t data24;
-  uint8_t data25;
-  uint8_t data26;
-  uint8_t data27;
-  uint8_t data28;
-  uint8_t data29;
-  uint8_t data30;
-  uint8_t data31;
-
-} ATLAS_eC_SensorData;
+/* Earliest the circuit can answer "r" (typical 600 ms), polled from there */
+#define READ_FIRST_POLL           (CLOCK_SECOND * 48 / 100)
+
+static int32_t ec;              /* uS/cm */
+static uint8_t ec_valid;        /* Cleared by a failed reading */
+/* GET representations, encoded once per new reading */
+static rep_cache_t rep_cache;
+static char rep_buf[160];
+/* Smallest change sent at once: 20 uS/cm */
+static report_channel_t report_channels[] = {
+  REPORT_CHANNEL(20),
+};
+static report_policy_t report_policy;
+/* Jobs of the wake-up scheduler */
+static wake_job_t report_job;      /* Heartbeat */
+static wake_job_t sample_job;
+/* Intervals set over CoAP, kept across reboots */
+extern coap_resource_t res_config;
+/* Energest of the last report period */
+extern coap_resource_t res_energy;
+/* CPU time of each process, also the "procstats" shell command */
+extern coap_resource_t res_proc_stats;
+#if TRACE_ON
+/* Trace ring of the production build */
+extern coap_resource_t res_trace;
 #endif
-
-static ATLAS_eC_SensorData sensor_data;
-static I2C_Handle i2c_handle;
-static char ascii_data[6]; 
+/* Observers are notified on the same change */
+static report_channel_t notify_channels[] = {
+  REPORT_CHANNEL(20),
+};
+static report_policy_t notify_policy;
 /*---------------------------------------------------------------------------*/
 PROCESS(udp_client_process, "UDP client");
 PROCESS(er_example_server, "CoAP Server");
 PROCESS(ph_sensor_process, "ph_sensor Process");
 AUTOSTART_PROCESSES(&er_example_server, &udp_client_process, &ph_sensor_process);
 
-static void receive_data_from_sensor() { 
-
-  if(i2c_arch_read(i2c_handle, EC_SENSOR_I2C_ADDR, &sensor_data, sizeof(sensor_data))) {                            
-    printf("\n");
-  }
-    i2c_arch_release(i2c_handle);
-  }
-
-void delay_ms(uint16_t ms) {
-    clock_delay_usec(ms * 1000);
-}
-
-static bool
-send_command_to_sensor(void) 
-{
-  bool rv;
-#if CONTIKI_BOARD_SENSORTAG_CC1352R1
-  uint8_t eC_reg[] = {0x72, 0x00};
-
-#endif
-
-  i2c_handle = i2c_arch_acquire(Board_I2C0);
-
-  rv = i2c_arch_write(i2c_handle, EC_SENSOR_I2C_ADDR, eC_reg,
-                      sizeof(eC_reg));
-
-  return rv;
-
-}
-
-void convert_to_ascii(ATLAS_eC_SensorData sensor_data) {
-    sprintf(ascii_data, "%c%c%c%c%c", sensor_data.data2, sensor_data.data3, sensor_data.data4, sensor_data.data5, sensor_data.data6);
-    printf("eC sensor: %s\n", ascii_data);
-
-}
-// void delay_ms(uint16_t ms) {
-//     clock_delay_usec(ms * 1000);
-// }
-
-static unsigned long
-to_seconds(uint64_t time)
-{
-  return (unsigned long)(time / ENERGEST_SECOND);
-}
-
 static void
 udp_rx_callback(struct simple_udp_connection *c,
          const uip_ipaddr_t *sender_addr,
@@ -151,7 +108,11 @@ udp_rx_callback(struct simple_udp_connection *c,
          const uint8_t *data,
          uint16_t datalen)
 {
-  LOG_INFO("Received response '%.*s' from ", datalen, (char *) data);
+  /* The only answer from the border router is a telemetry ack */
+  if(!backlog_input(data, datalen)) {
+    return;
+  }
+  LOG_INFO("Received ack from ");
   LOG_INFO_6ADDR(sender_addr);
 #if LLSEC802154_CONF_ENABLED
   LOG_INFO_(" LLSEC LV:%d", uipbuf_get_attr(UIPBUF_ATTR_LLSEC_LEVEL));
@@ -163,47 +124,64 @@ udp_rx_callback(struct simple_udp_connection *c,
 
 static void 
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_event_handler(void);
 
 /* A simple getter example. Returns the reading from temp humid light sensor with a simple etag */
-RESOURCE(res_ecsensor,
-         "title=\"DS18B20(supports JSON)\";rt=\"WatertempSensor\"",
-         res_get_handler,
-         NULL,
-         NULL,
-         NULL);
+EVENT_RESOURCE(res_ecsensor,
+               "title=\"DS18B20(supports JSON)\";rt=\"WatertempSensor\";obs",
+               res_get_handler,
+               NULL,
+               NULL,
+               NULL,
+               res_event_handler);
+
+/* Fills rep_cache, at most once per reading */
+static int
+res_encode(char *buf, uint16_t size, unsigned int format, const void *ptr)
+{
+  cbor_writer_t w;
+
+  switch(format) {
+  case TEXT_PLAIN:
+    return snprintf(buf, size, "eC sensor: %ld",
+                    (long)ec);
+  case APPLICATION_XML:
+    return snprintf(buf, size,
+                    "<sensor><ec val=\"%ld\" unit=\"uS/cm\"/></sensor>",
+                    (long)ec);
+  case APPLICATION_JSON:
+    return snprintf(buf, size,
+                    "{\"sensor\":{\"eC sensor\":%ld}}",
+                    (long)ec);
+  case REP_CACHE_CBOR:
+    /* Keyed and scaled like the telemetry frame */
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_map(&w, 1);
+    cbor_put_uint(&w, FARM_TLV_EC);
+    cbor_put_int(&w, ec);
+    return cbor_len(&w);
+  case REP_CACHE_SENML_CBOR:
+    /* SenML wants S/m, 1 uS/cm is 0.0001 S/m */
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_array(&w, 1);
+    senml_put_value(&w, senml_base_name(), "ec", "S/m", ec, 4);
+    return cbor_len(&w);
+  default:
+    return -1;
+  }
+}
 
 static void
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
+  rep_cache_serve(&rep_cache, request, response, preferred_size, offset);
+}
 
-  unsigned int accept = -1;
-  coap_get_header_accept(request, &accept);
-
-  if (accept == -1 || accept == TEXT_PLAIN) {
-    coap_set_header_content_format(response, TEXT_PLAIN);
-    snprintf((char *)buffer, preferred_size, "eC sensor: %s C", 
-             ascii_data);
-
-    coap_set_payload(response, (uint8_t *)buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_XML) {
-    coap_set_header_content_format(response, APPLICATION_XML);
-    snprintf((char *)buffer, preferred_size, 
-             "<sensor><eC sensor val=\"%s\" unit=\"C\"/>", 
-             ascii_data);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_JSON) {
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    snprintf((char *)buffer, preferred_size, 
-             "{\"sensor\":{\"eC sensor\":\"%s\"}", 
-             ascii_data);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else {
-    coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
-    const char *msg = "Supporting content-types text/plain, application/xml, and application/json";
-    coap_set_payload(response, msg, strlen(msg));
-  }
+/* Sends the current representation to every observer */
+static void
+res_event_handler(void)
+{
+  coap_notify_observers(&res_ecsensor);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -211,6 +189,20 @@ PROCESS_THREAD(er_example_server, ev, data)
 {
   PROCESS_BEGIN();
 
+  trace_init();
+
+  node_config_init(&sample_job, &report_job,
+                   SAMPLE_INTERVAL / CLOCK_SECOND,
+                   REPORT_POLICY_HEARTBEAT / CLOCK_SECOND);
+  proc_stats_attach(&er_example_server);
+  proc_stats_attach(&udp_client_process);
+  proc_stats_attach(&ph_sensor_process);
+
+  rep_cache_init(&rep_cache, rep_buf, sizeof(rep_buf), res_encode, NULL);
+
+  report_policy_init(&notify_policy, notify_channels,
+                     sizeof(notify_channels) / sizeof(notify_channels[0]),
+                     &er_example_server);
 
   PROCESS_PAUSE();
 
@@ -218,10 +210,21 @@ PROCESS_THREAD(er_example_server, ev, data)
 #if BOARD_SENSORTAG
   coap_activate_resource(&res_ecsensor, "builtinsensors/eCsensor");
 #endif
+  coap_activate_resource(&res_config, "config");
+  coap_activate_resource(&res_energy, "energy");
+  coap_activate_resource(&res_proc_stats, "procstats");
+#if TRACE_ON
+  coap_activate_resource(&res_trace, "trace");
+#endif
 
   /* Define application-specific events here. */
   while(1) {
     PROCESS_WAIT_EVENT();
+    /* A reading moved past its notify threshold */
+    if(ev == PROCESS_EVENT_POLL) {
+      res_ecsensor.trigger();
+      report_policy_reported(&notify_policy);
+    }
 #if PLATFORM_HAS_BUTTON
 #if PLATFORM_SUPPORTS_BUTTON_HAL
     if(ev == button_hal_release_event) {
@@ -238,26 +241,35 @@ PROCESS_THREAD(er_example_server, ev, data)
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(ph_sensor_process, ev, data)
 {
-    static struct etimer timer1;
+    static ezo_request_t request;
 
     PROCESS_BEGIN();
 
-    i2c_arch_init();    
+    i2c_arch_init();
+    ezo_init();
+    wake_add_sampler(&sample_job, &ph_sensor_process,
+                     node_config_sample_windows());
 
     while (1) {
-        memset(&sensor_data, 0, sizeof(sensor_data));
-
-        send_command_to_sensor();
-
-        etimer_set(&timer1, CLOCK_SECOND * 0.6);
-        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer1));
-
-        receive_data_from_sensor();
-
-        convert_to_ascii(sensor_data);
-
-        etimer_set(&timer1, SEND_INTERVAL); 
-        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer1));
+        /* Done as soon as the circuit has the reading, not after a fixed wait */
+        if(ezo_request(&request, EC_SENSOR_I2C_ADDR, "r", READ_FIRST_POLL)) {
+            PROCESS_WAIT_EVENT_UNTIL(ev == ezo_event && data == &request);
+        }
+
+        /* Never report a reading the circuit did not confirm */
+        ec_valid = ezo_fixed(&request, 0, &ec);
+        if(ec_valid) {
+            LOG_DBG("eC sensor: %ld\n", (long)ec);
+            report_policy_sample(&report_policy, 0, ec);
+            report_policy_sample(&notify_policy, 0, ec);
+            rep_cache_update(&rep_cache, node_config_sample_time() + READ_FIRST_POLL);
+        } else {
+            rep_cache_invalidate(&rep_cache);
+        }
+
+        /* Next round in a window shared with the report */
+        wake_done(&sample_job);
+        PROCESS_WAIT_EVENT_UNTIL(ev == wake_event);
     }
 
     PROCESS_END();
@@ -265,8 +277,8 @@ PROCESS_THREAD(ph_sensor_process, ev, data)
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(udp_client_process, ev, data)
 {
-  static struct etimer periodic_timer;
-  // static char str[128];
+  static uint8_t frame[FARM_FRAME_MAX_LEN];
+  farm_frame_writer_t writer;
   uip_ipaddr_t dest_ipaddr;
   static uint32_t tx_count;
   static uint32_t missed_tx_count;
@@ -276,11 +288,32 @@ PROCESS_THREAD(udp_client_process, ev, data)
   /* Initialize UDP connection */
   simple_udp_register(&udp_conn, UDP_CLIENT_PORT, NULL,
                       UDP_SERVER_PORT, udp_rx_callback);
+  backlog_init(&udp_conn);
+  energy_init();
+
+  report_policy_init(&report_policy, report_channels,
+                     sizeof(report_channels) / sizeof(report_channels[0]),
+                     &udp_client_process);
+
+  wake_add_reporter(&report_job, &udp_client_process,
+                    node_config_report_windows());
+
+  /* No frame before there is a sample to put in it */
+  while(!ec_valid) {
+    wake_restart(&report_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event || ev == PROCESS_EVENT_POLL);
+  }
 
-  etimer_set(&periodic_timer, random_rand() % SEND_INTERVAL);
   while(1) {
     // PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
 
+    farm_frame_begin(&writer, frame, sizeof(frame),
+                     FARM_MSG_TELEMETRY, FARM_NODE_EC);
+    backlog_put_seq(&writer);
+    if(ec_valid) {
+      farm_frame_put_int(&writer, FARM_TLV_EC, ec);
+    }
+
     if(NETSTACK_ROUTING.node_is_reachable() &&
         NETSTACK_ROUTING.get_root_ipaddr(&dest_ipaddr)) {
 
@@ -296,34 +329,36 @@ PROCESS_THREAD(udp_client_process, ev, data)
       LOG_INFO_("\n");      
 
 
-      // snprintf(ascii_data, sizeof(ascii_data), "eC sensor: %s\n",
-      //    ascii_data);      
-
-      simple_udp_sendto(&udp_conn, ascii_data, strlen(ascii_data), &dest_ipaddr);
+      /* Goes out behind any frames held while the node was away */
+      backlog_send(frame, farm_frame_len(&writer), &dest_ipaddr);
       tx_count++;
     } else {
-      LOG_INFO("Not reachable yet\n");
+      /* Held, not lost: sent in paced batches once the route is back */
+      backlog_put(frame, farm_frame_len(&writer));
+      LOG_INFO("Not reachable yet, %u frames held\n", backlog_count());
       if(tx_count > 0) {
         missed_tx_count++;   
       }   
     }
-    energest_flush();
-
-    printf("\nEnergest:\n");
-    printf(" CPU          %4lus LPM      %4lus DEEP LPM %4lus  Total time %lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_CPU)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_LPM)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_DEEP_LPM)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()));
-    printf(" Radio LISTEN %4lus TRANSMIT %4lus OFF      %4lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_LISTEN)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_TRANSMIT)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()
-                      - energest_type_time(ENERGEST_TYPE_TRANSMIT)
-                      - energest_type_time(ENERGEST_TYPE_LISTEN)));
-    /* Reset the timer */
-    etimer_set(&periodic_timer, SEND_INTERVAL);
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    report_policy_reported(&report_policy);
+    /* Energest of the period just reported, kept instead of printed */
+    energy_update();
+    res_energy.trigger();
+    energy_report(FARM_NODE_EC);
+
+    LOG_DBG("Reports %lu on change, %lu heartbeat\n",
+            (unsigned long)report_policy.change_reports,
+            (unsigned long)report_policy.heartbeat_reports);
+    LOG_DBG("Backlog %u held, %lu dropped, %lu resent\n",
+            backlog_count(), (unsigned long)backlog_dropped(),
+            (unsigned long)backlog_retransmitted());
+    LOG_DBG("Wake-ups %lu windows\n", (unsigned long)wake_windows());
+    /*
+     * Heartbeat in the shared wake-up window, the policy polls us in
+     * earlier when a value moves
+     */
+    wake_restart(&report_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event || ev == PROCESS_EVENT_POLL);
   }
 
   PROCESS_END();
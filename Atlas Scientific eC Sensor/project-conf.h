@@ -39,7 +39,8 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 
-#define LOG_LEVEL_APP LOG_LEVEL_DBG
+/* Log levels and trace ring, see build-profile.h */
+#include "build-profile.h"
 #define ENERGEST_CONF_ON 1
 
 
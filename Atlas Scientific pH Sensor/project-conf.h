@@ -39,8 +39,12 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 
-#define LOG_LEVEL_APP LOG_LEVEL_DBG
+/* Log levels and trace ring, see build-profile.h */
+#include "build-profile.h"
 #define ENERGEST_CONF_ON 1
 
+/* Read the eC circuit (0x64) too when it is wired to this node's I2C bus */
+#define ATLAS_CONF_WITH_EC 0
+
 
 #endif /* PROJECT_CONF_H_ */
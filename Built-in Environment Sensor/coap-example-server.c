@@ -7,7 +7,17 @@
 #include "board-peripherals.h"
 #include "coap-engine.h"
 #include "coap.h"
-#include "sys/energest.h"
+#include "rep-cache.h"
+#include "cbor.h"
+#include "farm-frame.h"
+#include "report-policy.h"
+#include "backlog.h"
+#include "wake.h"
+#include "node-config.h"
+#include "energy.h"
+#include "proc-stats.h"
+#include "trace.h"
+#include "aggregate.h"
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -29,13 +39,23 @@
 #define UDP_CLIENT_PORT   8765
 #define UDP_SERVER_PORT   5678
 
-#define SEND_INTERVAL     (5 * 60 * CLOCK_SECOND)
+/*
+ * Default, /config can change it. The sensors are read every second for
+ * the window min/max/mean; only the reports follow the wake-up windows.
+ */
+#define SAMPLE_INTERVAL   (1 * CLOCK_SECOND)
+
 
 static struct simple_udp_connection udp_conn;
 static uint32_t rx_count = 0;
 static int temperature, humidity, light; // Declare variables to store sensor readings
+/* Every good sample since the last report, sent along with it */
+static aggregate_t temperature_window, humidity_window, light_window;
 static clock_time_t send_time;
-static char str[128];
+static uint8_t frame[FARM_FRAME_MAX_LEN];
+/* GET representations, encoded once per new reading */
+static rep_cache_t rep_cache;
+static char rep_buf[384];
 /* Resource declaration */
 // extern coap_resource_t
 //   res_hello,
@@ -54,6 +74,33 @@ extern coap_resource_t res_hdc1000opt3001;
 // extern coap_resource_t res_toggle_yellow;
 #endif
 
+/* Smallest change sent at once: 0.5 deg C, 2 %RH, 5 lux */
+static report_channel_t report_channels[] = {
+  REPORT_CHANNEL(50),
+  REPORT_CHANNEL(200),
+  REPORT_CHANNEL(500),
+};
+static report_policy_t report_policy;
+/* Jobs of the wake-up scheduler */
+static wake_job_t report_job;      /* Heartbeat */
+static wake_job_t sample_job;
+/* Intervals set over CoAP, kept across reboots */
+extern coap_resource_t res_config;
+/* Energest of the last report period */
+extern coap_resource_t res_energy;
+/* CPU time of each process, also the "procstats" shell command */
+extern coap_resource_t res_proc_stats;
+#if TRACE_ON
+/* Trace ring of the production build */
+extern coap_resource_t res_trace;
+#endif
+/* Observers are notified on the same changes, at most every 10 s */
+static report_channel_t notify_channels[] = {
+  REPORT_CHANNEL(50),
+  REPORT_CHANNEL(200),
+  REPORT_CHANNEL(500),
+};
+static report_policy_t notify_policy;
 /*---------------------------------------------------------------------------*/
 
 PROCESS(udp_client_process, "UDP client");
@@ -62,11 +109,6 @@ PROCESS(temp_reading, "Temp reading Process");
 AUTOSTART_PROCESSES(&er_example_server, &udp_client_process, &temp_reading);
 
 /*---------------------------------------------------------------------------*/
-static unsigned long
-to_seconds(uint64_t time)
-{
-  return (unsigned long)(time / ENERGEST_SECOND);
-}
 
 static void
 udp_rx_callback(struct simple_udp_connection *c,
@@ -80,7 +122,11 @@ udp_rx_callback(struct simple_udp_connection *c,
   clock_time_t receive_time = clock_time();
   clock_time_t round_trip_time = receive_time - send_time;    
 
-  LOG_INFO("Received response '%.*s' from ", datalen, (char *) data);
+  /* The only answer from the border router is a telemetry ack */
+  if(!backlog_input(data, datalen)) {
+    return;
+  }
+  LOG_INFO("Received ack from ");
   LOG_INFO_6ADDR(sender_addr);
 #if LLSEC802154_CONF_ENABLED
   LOG_INFO_(" LLSEC LV:%d", uipbuf_get_attr(UIPBUF_ATTR_LLSEC_LEVEL));
@@ -90,111 +136,129 @@ udp_rx_callback(struct simple_udp_connection *c,
   rx_count++;
 }
 
-static void
-// get_sync_sensor_readings(int *temperature, int *humidity, int *light)
-get_sync_sensor_readings(int *temperature, int *humidity, int *light)
+/* Bits returned by get_sync_sensor_readings() for the good readings */
+#define READING_TEMPERATURE 0x01
+#define READING_HUMIDITY    0x02
+#define READING_LIGHT       0x04
 
+static int
+get_sync_sensor_readings(int *temperature, int *humidity, int *light)
 {
   int value;
+  int ok = 0;
 
   /* HDC1000 Sensor */
   value = hdc_1000_sensor.value(HDC_1000_SENSOR_TYPE_TEMP);
   if(value != HDC_1000_READING_ERROR) {
-    printf("HDC: Temp=%d.%02d C\n", value / 100, value % 100);
+    LOG_DBG("HDC: Temp=%d.%02d C\n", value / 100, value % 100);
     *temperature = value;
+    ok |= READING_TEMPERATURE;
   } else {
-    printf("HDC: Temp Read Error\n");
+    LOG_WARN("HDC: Temp Read Error\n");
+    TRACE(TRACE_SAMPLE_ERROR, 0, 0);
     *temperature = 0;
   }
 
   value = hdc_1000_sensor.value(HDC_1000_SENSOR_TYPE_HUMID);
   if(value != HDC_1000_READING_ERROR) {
-    printf("HDC: Humidity=%d.%02d %%RH\n", value / 100, value % 100);
+    LOG_DBG("HDC: Humidity=%d.%02d %%RH\n", value / 100, value % 100);
     *humidity = value;
+    ok |= READING_HUMIDITY;
   } else {
-    printf("HDC: Humidity Read Error\n");
+    LOG_WARN("HDC: Humidity Read Error\n");
+    TRACE(TRACE_SAMPLE_ERROR, 1, 0);
     *humidity = 0;
   }
 
   /* Light Sensor */
   value = opt_3001_sensor.value(0);
   if(value != OPT_3001_READING_ERROR) {
-    printf("OPT: Light=%d.%02d lux\n", value / 100, value % 100);
+    LOG_DBG("OPT: Light=%d.%02d lux\n", value / 100, value % 100);
     *light = value;
+    ok |= READING_LIGHT;
   } else {
-    printf("OPT: Light Read Error\n");
+    LOG_WARN("OPT: Light Read Error\n");
+    TRACE(TRACE_SAMPLE_ERROR, 2, 0);
     *light = 0;
   }
   // printf("Sensor Values: Temperature=%d, Humidity=%d, Light=%d\n", sensor_values[0], sensor_values[1], sensor_values[2]);
 
-  printf("-----------------------------------------\n");
   SENSORS_ACTIVATE(hdc_1000_sensor);
   SENSORS_ACTIVATE(opt_3001_sensor);
+  return ok;
 }
 
 static void 
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_event_handler(void);
 
 /* A simple getter example. Returns the reading from temp humid light sensor with a simple etag */
-RESOURCE(res_hdc1000opt3001,
-         "title=\"hdc1000 and opt 3001(supports JSON)\";rt=\"TempHumidLightSensor\"",
-         res_get_handler,
-         NULL,
-         NULL,
-         NULL);
+EVENT_RESOURCE(res_hdc1000opt3001,
+               "title=\"hdc1000 and opt 3001(supports JSON)\";rt=\"TempHumidLightSensor\";obs",
+               res_get_handler,
+               NULL,
+               NULL,
+               NULL,
+               res_event_handler);
+
+/* Fills rep_cache, at most once per reading */
+static int
+res_encode(char *buf, uint16_t size, unsigned int format, const void *ptr)
+{
+  cbor_writer_t w;
+
+  switch(format) {
+  case TEXT_PLAIN:
+    return snprintf(buf, size, "Temperature: " REP_FIXED2_FMT " C, Humidity: " REP_FIXED2_FMT " %%, Light: " REP_FIXED2_FMT " lux",
+                    REP_FIXED2(temperature),
+                    REP_FIXED2(humidity),
+                    REP_FIXED2(light));
+  case APPLICATION_XML:
+    return snprintf(buf, size,
+                    "<sensor><temperature val=\"" REP_FIXED2_FMT "\" unit=\"C\"/><humidity val=\"" REP_FIXED2_FMT "\" unit=\"%%RH\"/><light val=\"" REP_FIXED2_FMT "\" unit=\"lux\"/></sensor>",
+                    REP_FIXED2(temperature),
+                    REP_FIXED2(humidity),
+                    REP_FIXED2(light));
+  case APPLICATION_JSON:
+    return snprintf(buf, size,
+                    "{\"sensor\":{\"temperature\":" REP_FIXED2_FMT ",\"humidity\":" REP_FIXED2_FMT ",\"light\":" REP_FIXED2_FMT "}}",
+                    REP_FIXED2(temperature),
+                    REP_FIXED2(humidity),
+                    REP_FIXED2(light));
+  case REP_CACHE_CBOR:
+    /* Keyed and scaled like the telemetry frame */
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_map(&w, 3);
+    cbor_put_uint(&w, FARM_TLV_TEMPERATURE);
+    cbor_put_int(&w, temperature);
+    cbor_put_uint(&w, FARM_TLV_HUMIDITY);
+    cbor_put_int(&w, humidity);
+    cbor_put_uint(&w, FARM_TLV_LIGHT);
+    cbor_put_int(&w, light);
+    return cbor_len(&w);
+  case REP_CACHE_SENML_CBOR:
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_array(&w, 3);
+    senml_put_value(&w, senml_base_name(), "temperature", "Cel", temperature, 2);
+    senml_put_value(&w, NULL, "humidity", "%RH", humidity, 2);
+    senml_put_value(&w, NULL, "light", "lx", light, 2);
+    return cbor_len(&w);
+  default:
+    return -1;
+  }
+}
 
 static void
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
+  rep_cache_serve(&rep_cache, request, response, preferred_size, offset);
+}
 
-  // if (temperature == 0 && humidity == 0 && light == 0) {
-  //   // Attempt to read the sensor values again
-  //   int attempts = 3; // Maximum number of attempts
-  //   while (attempts--) {
-  //     // Wait for a short duration before retrying
-
-
-  //     // Check if any sensor reading is non-zero
-  //     // if (hdc_temp_val != 0 || hdc_humid_val != 0 || opt_light_val != 0) {
-  //     //   break; // Exit the loop if any reading is non-zero
-  //     // }
-  //   }
-  // }
-
-  unsigned int accept = -1;
-  coap_get_header_accept(request, &accept);
-
-  if (accept == -1 || accept == TEXT_PLAIN) {
-    coap_set_header_content_format(response, TEXT_PLAIN);
-    snprintf((char *)buffer, preferred_size, "Temperature: %d.%02d C, Humidity: %d.%02d %%, Light: %d.%02d lux", 
-             temperature / 100, temperature % 100, 
-             humidity / 100, humidity % 100, 
-             light / 100, light % 100);
-
-    coap_set_payload(response, (uint8_t *)buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_XML) {
-    coap_set_header_content_format(response, APPLICATION_XML);
-    snprintf((char *)buffer, preferred_size, 
-             "<sensor><temperature val=\"%d.%02d\" unit=\"C\"/><humidity val=\"%d.%02d\" unit=\"%%RH\"/><light val=\"%d.%02d\" unit=\"lux\"/></sensor>", 
-             temperature / 100, temperature % 100, 
-             humidity / 100, humidity % 100, 
-             light / 100, light % 100);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_JSON) {
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    snprintf((char *)buffer, preferred_size, 
-             "{\"sensor\":{\"temperature\":\"%d.%02d\",\"humidity\":\"%d.%02d\",\"light\":\"%d.%02d\"}}", 
-             temperature / 100, temperature % 100, 
-             humidity / 100, humidity % 100, 
-             light / 100, light % 100);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else {
-    coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
-    const char *msg = "Supporting content-types text/plain, application/xml, and application/json";
-    coap_set_payload(response, msg, strlen(msg));
-  }
+/* Sends the current representation to every observer */
+static void
+res_event_handler(void)
+{
+  coap_notify_observers(&res_hdc1000opt3001);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -202,6 +266,20 @@ PROCESS_THREAD(er_example_server, ev, data)
 {
   PROCESS_BEGIN();
 
+  trace_init();
+
+  node_config_init(&sample_job, &report_job,
+                   SAMPLE_INTERVAL / CLOCK_SECOND,
+                   REPORT_POLICY_HEARTBEAT / CLOCK_SECOND);
+  proc_stats_attach(&er_example_server);
+  proc_stats_attach(&udp_client_process);
+  proc_stats_attach(&temp_reading);
+
+  rep_cache_init(&rep_cache, rep_buf, sizeof(rep_buf), res_encode, NULL);
+
+  report_policy_init(&notify_policy, notify_channels,
+                     sizeof(notify_channels) / sizeof(notify_channels[0]),
+                     &er_example_server);
 
   PROCESS_PAUSE();
 
@@ -209,10 +287,21 @@ PROCESS_THREAD(er_example_server, ev, data)
 #if BOARD_SENSORTAG
   coap_activate_resource(&res_hdc1000opt3001, "builtinsensors/temp_humidity_light");
 #endif
+  coap_activate_resource(&res_config, "config");
+  coap_activate_resource(&res_energy, "energy");
+  coap_activate_resource(&res_proc_stats, "procstats");
+#if TRACE_ON
+  coap_activate_resource(&res_trace, "trace");
+#endif
 
   /* Define application-specific events here. */
   while(1) {
     PROCESS_WAIT_EVENT();
+    /* A reading moved past its notify threshold */
+    if(ev == PROCESS_EVENT_POLL) {
+      res_hdc1000opt3001.trigger();
+      report_policy_reported(&notify_policy);
+    }
 #if PLATFORM_HAS_BUTTON
 #if PLATFORM_SUPPORTS_BUTTON_HAL
     if(ev == button_hal_release_event) {
@@ -229,29 +318,55 @@ PROCESS_THREAD(er_example_server, ev, data)
 /*----------------------------------------------------------------------------*/
 PROCESS_THREAD(temp_reading, ev, data)
 {
-  static struct etimer et;
-  PROCESS_BEGIN();
-
-  etimer_set(&et, CLOCK_SECOND);
-  while(1) {
+  static struct etimer sample_timer;
+  int ok;
 
-    // Wait for the timer to expire
+  PROCESS_BEGIN();
 
-    // Check the status of the float switch
-    get_sync_sensor_readings(&temperature, &humidity, &light);
+  aggregate_reset(&temperature_window);
+  aggregate_reset(&humidity_window);
+  aggregate_reset(&light_window);
 
-    snprintf(str, sizeof(str), "Temperature: %d, Humidity: %d, Light: %d\n",
-      temperature, 
-      humidity, 
-      light);   
+  /*
+   * A sample in the wake-up window, so the report has a fresh one, and
+   * below WAKE_PERIOD more in between on sample_timer. Each window starts
+   * the timer over, which keeps the samples on the window grid.
+   */
+  wake_add_sampler(&sample_job, &temp_reading, node_config_sample_windows());
+  while(1) {
+    ok = get_sync_sensor_readings(&temperature, &humidity, &light);
+    if(ok & READING_TEMPERATURE) {
+      aggregate_add(&temperature_window, temperature);
+      report_policy_sample(&report_policy, 0, temperature);
+      report_policy_sample(&notify_policy, 0, temperature);
+    }
+    if(ok & READING_HUMIDITY) {
+      aggregate_add(&humidity_window, humidity);
+      report_policy_sample(&report_policy, 1, humidity);
+      report_policy_sample(&notify_policy, 1, humidity);
+    }
+    if(ok & READING_LIGHT) {
+      aggregate_add(&light_window, light);
+      report_policy_sample(&report_policy, 2, light);
+      report_policy_sample(&notify_policy, 2, light);
+    }
+    if(ok) {
+      rep_cache_update(&rep_cache, node_config_sample_time());
+    }
 
     // LOG_INFO_("Temperature: %d, Humidity: %d, Light: %d\n",
     //   temperature, 
     //   humidity, 
     //   light);
 
-    etimer_set(&et, CLOCK_SECOND);    
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));    
+    wake_done(&sample_job);
+    if(node_config_sample_time() < WAKE_PERIOD) {
+      etimer_set(&sample_timer, node_config_sample_time());
+    } else {
+      etimer_stop(&sample_timer);
+    }
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event ||
+                             (ev == PROCESS_EVENT_TIMER && data == &sample_timer));
   }
 
   PROCESS_END();
@@ -259,21 +374,46 @@ PROCESS_THREAD(temp_reading, ev, data)
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(udp_client_process, ev, data)
 {
-  static struct etimer periodic_timer;
   uip_ipaddr_t dest_ipaddr;
   static uint32_t tx_count;
   static uint32_t missed_tx_count;
+  farm_frame_writer_t writer;
 
   PROCESS_BEGIN();
 
   /* Initialize UDP connection */
   simple_udp_register(&udp_conn, UDP_CLIENT_PORT, NULL,
                       UDP_SERVER_PORT, udp_rx_callback);
+  backlog_init(&udp_conn);
+  energy_init();
+
+  report_policy_init(&report_policy, report_channels,
+                     sizeof(report_channels) / sizeof(report_channels[0]),
+                     &udp_client_process);
+
+  wake_add_reporter(&report_job, &udp_client_process,
+                    node_config_report_windows());
+
+  /* No frame before there is a sample to put in it */
+  while(temperature_window.count == 0 && humidity_window.count == 0 &&
+        light_window.count == 0) {
+    wake_restart(&report_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event || ev == PROCESS_EVENT_POLL);
+  }
 
-  etimer_set(&periodic_timer, SEND_INTERVAL);
   while(1) {
     // PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
 
+    farm_frame_begin(&writer, frame, sizeof(frame),
+                     FARM_MSG_TELEMETRY, FARM_NODE_ENV);
+    backlog_put_seq(&writer);
+    /* Last, min, max and mean of each channel over the window */
+    farm_frame_put_int(&writer, FARM_TLV_WINDOW_SAMPLES,
+                       MAX(temperature_window.count, light_window.count));
+    aggregate_put(&writer, FARM_TLV_TEMPERATURE, &temperature_window);
+    aggregate_put(&writer, FARM_TLV_HUMIDITY, &humidity_window);
+    aggregate_put(&writer, FARM_TLV_LIGHT, &light_window);
+
     if(NETSTACK_ROUTING.node_is_reachable() &&
         NETSTACK_ROUTING.get_root_ipaddr(&dest_ipaddr)) {
 
@@ -304,31 +444,39 @@ PROCESS_THREAD(udp_client_process, ev, data)
 
       send_time = clock_time();
 
-      simple_udp_sendto(&udp_conn, str, strlen(str), &dest_ipaddr);
+      /* Goes out behind any frames held while the node was away */
+      backlog_send(frame, farm_frame_len(&writer), &dest_ipaddr);
       tx_count++;
     } else {
-      LOG_INFO("Not reachable yet\n");
+      /* Held, not lost: sent in paced batches once the route is back */
+      backlog_put(frame, farm_frame_len(&writer));
+      LOG_INFO("Not reachable yet, %u frames held\n", backlog_count());
       if(tx_count > 0) {
         missed_tx_count++;   
       }   
     }
-    energest_flush();
-
-    printf("\nEnergest:\n");
-    printf(" CPU          %4lus LPM      %4lus DEEP LPM %4lus  Total time %lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_CPU)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_LPM)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_DEEP_LPM)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()));
-    printf(" Radio LISTEN %4lus TRANSMIT %4lus OFF      %4lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_LISTEN)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_TRANSMIT)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()
-                      - energest_type_time(ENERGEST_TYPE_TRANSMIT)
-                      - energest_type_time(ENERGEST_TYPE_LISTEN)));
-    /* Reset the timer */
-    etimer_set(&periodic_timer, SEND_INTERVAL);
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    report_policy_reported(&report_policy);
+    aggregate_reset(&temperature_window);
+    aggregate_reset(&humidity_window);
+    aggregate_reset(&light_window);
+    /* Energest of the period just reported, kept instead of printed */
+    energy_update();
+    res_energy.trigger();
+    energy_report(FARM_NODE_ENV);
+
+    LOG_DBG("Reports %lu on change, %lu heartbeat\n",
+            (unsigned long)report_policy.change_reports,
+            (unsigned long)report_policy.heartbeat_reports);
+    LOG_DBG("Backlog %u held, %lu dropped, %lu resent\n",
+            backlog_count(), (unsigned long)backlog_dropped(),
+            (unsigned long)backlog_retransmitted());
+    LOG_DBG("Wake-ups %lu windows\n", (unsigned long)wake_windows());
+    /*
+     * Heartbeat in the shared wake-up window, the policy polls us in
+     * earlier when a value moves
+     */
+    wake_restart(&report_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event || ev == PROCESS_EVENT_POLL);
   }
 
   PROCESS_END();
@@ -39,8 +39,12 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 
-#define LOG_LEVEL_APP LOG_LEVEL_DBG
+/* Log levels and trace ring, see build-profile.h */
+#include "build-profile.h"
 #define ENERGEST_CONF_ON 1
 
+/* The HDC1000 and OPT3001 are read every second, between the windows */
+#define NODE_CONFIG_CONF_SAMPLE_MIN 1
+
 
 #endif /* PROJECT_CONF_H_ */
@@ -8,7 +8,17 @@
 #include "board-peripherals.h"
 #include "coap-engine.h"
 #include "coap.h"
-#include "sys/energest.h"
+#include "rep-cache.h"
+#include "cbor.h"
+#include "farm-frame.h"
+#include "report-policy.h"
+#include "backlog.h"
+#include "wake.h"
+#include "node-config.h"
+#include "energy.h"
+#include "proc-stats.h"
+#include "trace.h"
+#include "ds18b20.h"
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -30,7 +40,8 @@
 #define UDP_CLIENT_PORT   8768
 #define UDP_SERVER_PORT   5678
 
-#define SEND_INTERVAL     (5 * 60 * CLOCK_SECOND)
+/* Default, /config can change it */
+#define SAMPLE_INTERVAL   (60 * CLOCK_SECOND)
 
 static struct simple_udp_connection udp_conn;
 static uint32_t rx_count = 0;
@@ -39,12 +50,37 @@ static uint32_t rx_count = 0;
 extern coap_resource_t res_ds18b20;
 #endif
 
-extern gpio_hal_pin_t out_pin1;
-#if GPIO_HAL_PORT_PIN_NUMBERING
-extern gpio_hal_port_t out_port1;
+static int temperature[DS18B20_MAX_DEVICES]; /* 0.01 deg C, by probe */
+static uint8_t temperature_valid[DS18B20_MAX_DEVICES];
+/* GET representations of each probe, encoded once per new reading */
+static rep_cache_t rep_cache[DS18B20_MAX_DEVICES];
+static char rep_buf[DS18B20_MAX_DEVICES][192];
+static uint8_t pending_resolution; /* Applied before the next conversion */
+/* One channel per probe, a change of 0.25 deg C is sent at once */
+#define WATER_TEMP_DELTA  25
+static report_channel_t report_channels[DS18B20_MAX_DEVICES];
+static report_policy_t report_policy;
+/* Jobs of the wake-up scheduler */
+static wake_job_t report_job;      /* Heartbeat */
+static wake_job_t sample_job;
+/* Intervals set over CoAP, kept across reboots */
+extern coap_resource_t res_config;
+/* Energest of the last report period */
+extern coap_resource_t res_energy;
+/* CPU time of each process, also the "procstats" shell command */
+extern coap_resource_t res_proc_stats;
+#if TRACE_ON
+/* Trace ring of the production build */
+extern coap_resource_t res_trace;
 #endif
-
-static int temperature;
+/*
+ * Observers get the default representation, probe 0: the CoAP engine
+ * drops the query when it notifies.
+ */
+static report_channel_t notify_channels[] = {
+  REPORT_CHANNEL(WATER_TEMP_DELTA),
+};
+static report_policy_t notify_policy;
 /*---------------------------------------------------------------------------*/
 
 PROCESS(udp_client_process, "UDP client");
@@ -53,75 +89,6 @@ PROCESS(ds18b20_process, "DS18B20 Process");
 AUTOSTART_PROCESSES(&er_example_server, &udp_client_process, &ds18b20_process);
 
 /*---------------------------------------------------------------------------*/
-void delay_ms(uint16_t ms) {
-    clock_delay_usec(ms * 1000);
-}
-int DS18B20_Start(void) {
-    int Response = 0;
-    gpio_hal_arch_pin_set_output(out_port1, out_pin1);   // set the pin as output
-    gpio_hal_arch_write_pin(out_port1, out_pin1, 0);        // pull the pin low
-    RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(480UL));   // delay according to datasheet
-    
-    gpio_hal_arch_pin_set_input(out_port1, out_pin1);    // set the pin as input
-    RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(80UL));    // delay according to datasheet
-
-    if (!(gpio_hal_arch_read_pin(out_port1, out_pin1))) {
-        Response = 1;    // if the pin is low i.e the presence pulse is detected
-    } else {
-        Response = -1;
-    }
-
-    RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(400UL));; // 480 us delay totally
-    
-
-    return Response;
-}
-
-
-void DS18B20_Write(uint8_t data) {
-    gpio_hal_arch_pin_set_output(out_port1, out_pin1);  // set as output
-
-    for (int i = 0; i < 8; i++) {
-        if ((data & (1 << i)) != 0) {
-            // write 1
-            gpio_hal_arch_pin_set_output(out_port1, out_pin1);  // set as output
-            gpio_hal_arch_write_pin(out_port1, out_pin1, 0);        // pull the pin LOW
-            RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(1UL));  // wait for 1 us
-            gpio_hal_arch_pin_set_input(out_port1, out_pin1);   // set as input
-            RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(50UL));  // wait for 60 us
-        } else {
-            // write 0
-            gpio_hal_arch_pin_set_output(out_port1, out_pin1);
-            gpio_hal_arch_write_pin(out_port1, out_pin1, 0);        // pull the pin LOW
-            RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(50UL));  // wait for 60 us
-            gpio_hal_arch_pin_set_input(out_port1, out_pin1);    // set as input
-        }
-    }
-}
-
-uint8_t DS18B20_Read(void) {
-    uint8_t value = 0;
-    gpio_hal_arch_pin_set_input(out_port1, out_pin1);         // set as input
-
-    for (int i = 0; i < 8; i++) {
-        gpio_hal_arch_pin_set_output(out_port1, out_pin1);     // set as output
-        gpio_hal_arch_write_pin(out_port1, out_pin1, 0);       // pull the data pin LOW
-        RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(2UL));  // wait for 2 us
-        gpio_hal_arch_pin_set_input(out_port1, out_pin1);   // set as input
-        if (gpio_hal_arch_read_pin(out_port1, out_pin1)) {  // if the pin is HIGH
-            value |= (1 << i);  // read = 1
-        }
-        RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(60UL));  // wait for 60 us
-    }
-    return value;
-    
-}
-
-static unsigned long
-to_seconds(uint64_t time)
-{
-  return (unsigned long)(time / ENERGEST_SECOND);
-}
 
 static void
 udp_rx_callback(struct simple_udp_connection *c,
@@ -132,7 +99,11 @@ udp_rx_callback(struct simple_udp_connection *c,
          const uint8_t *data,
          uint16_t datalen)
 {
-  LOG_INFO("Received response '%.*s' from ", datalen, (char *) data);
+  /* The only answer from the border router is a telemetry ack */
+  if(!backlog_input(data, datalen)) {
+    return;
+  }
+  LOG_INFO("Received ack from ");
   LOG_INFO_6ADDR(sender_addr);
 #if LLSEC802154_CONF_ENABLED
   LOG_INFO_(" LLSEC LV:%d", uipbuf_get_attr(UIPBUF_ATTR_LLSEC_LEVEL));
@@ -143,64 +114,179 @@ udp_rx_callback(struct simple_udp_connection *c,
 
 static void 
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_event_handler(void);
+static void
+res_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
 
 /* A simple getter example. Returns the reading from temp humid light sensor with a simple etag */
-RESOURCE(res_ds18b20,
-         "title=\"DS18B20(supports JSON)\";rt=\"WatertempSensor\"",
-         res_get_handler,
-         NULL,
-         NULL,
-         NULL);
+EVENT_RESOURCE(res_ds18b20,
+               "title=\"DS18B20(supports JSON), PUT resolution=9..12\";rt=\"WatertempSensor\";obs",
+               res_get_handler,
+               NULL,
+               res_put_handler,
+               NULL,
+               res_event_handler);
+
+/* Fills the rep_cache of one probe, at most once per reading */
+static int
+res_encode(char *buf, uint16_t size, unsigned int format, const void *ptr)
+{
+  const int *t = ptr;
+  char name[24];
+  cbor_writer_t w;
+
+  switch(format) {
+  case TEXT_PLAIN:
+    return snprintf(buf, size, "Temperature: " REP_FIXED2_FMT " C",
+                    REP_FIXED2(*t));
+  case APPLICATION_XML:
+    return snprintf(buf, size,
+                    "<sensor><temperature val=\"" REP_FIXED2_FMT "\" unit=\"C\"/></sensor>",
+                    REP_FIXED2(*t));
+  case APPLICATION_JSON:
+    return snprintf(buf, size,
+                    "{\"sensor\":{\"temperature\":" REP_FIXED2_FMT "}}",
+                    REP_FIXED2(*t));
+  case REP_CACHE_CBOR:
+    /* Keyed and scaled like the telemetry frame */
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_map(&w, 2);
+    cbor_put_uint(&w, FARM_TLV_PROBE);
+    cbor_put_uint(&w, (uint32_t)(t - temperature));
+    cbor_put_uint(&w, FARM_TLV_WATER_TEMP);
+    cbor_put_int(&w, *t);
+    return cbor_len(&w);
+  case REP_CACHE_SENML_CBOR:
+    snprintf(name, sizeof(name), "probe%d/temperature", (int)(t - temperature));
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_array(&w, 1);
+    senml_put_value(&w, senml_base_name(), name, "Cel", *t, 2);
+    return cbor_len(&w);
+  default:
+    return -1;
+  }
+}
 
 static void
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
+  const char *query = NULL;
+  size_t len;
+  size_t i;
+  int probe = 0;
+
+  /* ?probe=N picks a probe on the bus, the first one by default. The
+     value is not terminated, parse exactly len digits */
+  len = coap_get_query_variable(request, "probe", &query);
+  if(query != NULL && (len == 0 || len > 2)) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+    return;
+  }
+  for(i = 0; i < len; i++) {
+    if(query[i] < '0' || query[i] > '9') {
+      coap_set_status_code(response, BAD_REQUEST_4_00);
+      return;
+    }
+    probe = probe * 10 + (query[i] - '0');
+  }
+  if(ds18b20_count() == 0) {
+    coap_set_status_code(response, NOT_FOUND_4_04);
+    return;
+  }
+  if(probe >= ds18b20_count()) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+    return;
+  }
+
+  rep_cache_serve(&rep_cache[probe], request, response, preferred_size,
+                  offset);
+}
+
+/* Sends the current representation to every observer */
+static void
+res_event_handler(void)
+{
+  coap_notify_observers(&res_ds18b20);
+}
+
+static void
+res_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  const char *value = NULL;
+  size_t len;
+  size_t i;
+  int bits = 0;
+
+  /* The value is not terminated, parse exactly len digits */
+  len = coap_get_post_variable(request, "resolution", &value);
+  if(len == 0 || len > 2) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+    return;
+  }
+  for(i = 0; i < len; i++) {
+    if(value[i] < '0' || value[i] > '9') {
+      coap_set_status_code(response, BAD_REQUEST_4_00);
+      return;
+    }
+    bits = bits * 10 + (value[i] - '0');
+  }
 
-  unsigned int accept = -1;
-  coap_get_header_accept(request, &accept);
-
-  if (accept == -1 || accept == TEXT_PLAIN) {
-    coap_set_header_content_format(response, TEXT_PLAIN);
-    snprintf((char *)buffer, preferred_size, "Temperature: %d.%02d C", 
-             temperature / 100, temperature % 100);
-
-    coap_set_payload(response, (uint8_t *)buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_XML) {
-    coap_set_header_content_format(response, APPLICATION_XML);
-    snprintf((char *)buffer, preferred_size, 
-             "<sensor><temperature val=\"%d.%02d\" unit=\"C\"/>", 
-             temperature / 100, temperature % 100);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_JSON) {
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    snprintf((char *)buffer, preferred_size, 
-             "{\"sensor\":{\"temperature\":\"%d.%02d\"}", 
-             temperature / 100, temperature % 100);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else {
-    coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
-    const char *msg = "Supporting content-types text/plain, application/xml, and application/json";
-    coap_set_payload(response, msg, strlen(msg));
+  if(bits < DS18B20_RESOLUTION_MIN || bits > DS18B20_RESOLUTION_MAX) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+    return;
   }
+
+  /* The bus may be mid-conversion, let ds18b20_process apply it */
+  pending_resolution = bits;
+  coap_set_status_code(response, CHANGED_2_04);
 }
 
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(er_example_server, ev, data)
 {
+  int i;
+
   PROCESS_BEGIN();
 
+  trace_init();
+
+  node_config_init(&sample_job, &report_job,
+                   SAMPLE_INTERVAL / CLOCK_SECOND,
+                   REPORT_POLICY_HEARTBEAT / CLOCK_SECOND);
+  proc_stats_attach(&er_example_server);
+  proc_stats_attach(&udp_client_process);
+  proc_stats_attach(&ds18b20_process);
+
+  for(i = 0; i < DS18B20_MAX_DEVICES; i++) {
+    rep_cache_init(&rep_cache[i], rep_buf[i], sizeof(rep_buf[i]),
+                   res_encode, &temperature[i]);
+  }
+
+  report_policy_init(&notify_policy, notify_channels,
+                     sizeof(notify_channels) / sizeof(notify_channels[0]),
+                     &er_example_server);
+
   PROCESS_PAUSE();
 
 
 #if BOARD_SENSORTAG
   coap_activate_resource(&res_ds18b20, "builtinsensors/watertemp");
 #endif
+  coap_activate_resource(&res_config, "config");
+  coap_activate_resource(&res_energy, "energy");
+  coap_activate_resource(&res_proc_stats, "procstats");
+#if TRACE_ON
+  coap_activate_resource(&res_trace, "trace");
+#endif
 
   /* Define application-specific events here. */
   while(1) {
     PROCESS_WAIT_EVENT();
+    /* A reading moved past its notify threshold */
+    if(ev == PROCESS_EVENT_POLL) {
+      res_ds18b20.trigger();
+      report_policy_reported(&notify_policy);
+    }
 #if PLATFORM_HAS_BUTTON
 #if PLATFORM_SUPPORTS_BUTTON_HAL
     if(ev == button_hal_release_event) {
@@ -218,80 +304,158 @@ PROCESS_THREAD(er_example_server, ev, data)
 PROCESS_THREAD(ds18b20_process, ev, data)
 {
   static struct etimer et;
-  uint8_t Temp_byte1;
-  uint8_t Temp_byte2;
+  static uint8_t rescan = 1;
   int16_t temp_raw;
-
+  uint8_t bits;
+  int i;
+  int j;
 
   PROCESS_BEGIN();
 
-  etimer_set(&et, SEND_INTERVAL);  
-
+  wake_add_sampler(&sample_job, &ds18b20_process,
+                   node_config_sample_windows());
   while(1) {
-    // PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
-    // PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
-
-    int Presence = DS18B20_Start ();
-    if (Presence == 1) {
-        // printf("DS18B20 detected!\n");
-        // RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(1UL));
-        delay_ms(1);
-        DS18B20_Write(0xCC);  // Skip ROM
-        DS18B20_Write(0x44);  // Convert temperature
-        // RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(800UL));
-        delay_ms(800);
-        
-
-        Presence = DS18B20_Start ();
-        // RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(1UL));
-        delay_ms(1);
-        DS18B20_Write(0xCC);  // Skip ROM
-        DS18B20_Write(0xBE);  // Read Scratch-pad
-
-        Temp_byte1 = DS18B20_Read();
-        // printf("Temp_byte1: %" PRIu8 "\n", Temp_byte1);
-        Temp_byte2 = DS18B20_Read();
-        // printf("Temp_byte2: %" PRIu8 "\n", Temp_byte2);
-        temp_raw = (Temp_byte2 << 8) | Temp_byte1;
-        // printf("temp_raw: %" PRIu16 "\n", temp_raw);
-        temperature = temp_raw / 16;
-        printf("Water Temperature=%d.%02d°C\n", temperature, temp_raw % 16);
+    if(rescan) {
+      ds18b20_search();
+      memset(temperature_valid, 0, sizeof(temperature_valid));
+      LOG_INFO("DS18B20 probes found: %d\n", ds18b20_count());
+      for(i = 0; i < ds18b20_count(); i++) {
+        LOG_INFO(" %d:", i);
+        for(j = 0; j < DS18B20_ROM_LEN; j++) {
+          LOG_INFO_("%02x", ds18b20_rom(i)[j]);
+        }
+        LOG_INFO_("\n");
+      }
+    }
 
+    /* New probes come up at their own resolution, set it after a search too */
+    if(rescan || pending_resolution != 0) {
+      bits = pending_resolution != 0 ? pending_resolution : ds18b20_get_resolution();
+      if(ds18b20_set_resolution(bits)) {
+        LOG_INFO("DS18B20 resolution %u bits\n", bits);
+      } else {
+        LOG_WARN("DS18B20 resolution not set!\n");
+      }
+      pending_resolution = 0;
+    }
+    rescan = 0;
+
+    /*
+     * One broadcast conversion for every probe on the bus, then sleep on
+     * an etimer instead of busy-waiting, the radio and the other
+     * processes keep running meanwhile.
+     */
+    if(ds18b20_count() > 0 && ds18b20_convert()) {
+      etimer_set(&et, ds18b20_conversion_time());
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+      for(i = 0; i < ds18b20_count(); i++) {
+        if(ds18b20_read_temperature(i, &temp_raw)) {
+          temperature[i] = (temp_raw * 100) / 16;
+          temperature_valid[i] = 1;
+          report_policy_sample(&report_policy, i, temperature[i]);
+          if(i == 0) {
+            report_policy_sample(&notify_policy, 0, temperature[0]);
+          }
+          rep_cache_update(&rep_cache[i],
+                           node_config_sample_time() + ds18b20_conversion_time());
+          LOG_DBG("Water Temperature %d=%d.%02d°C\n", i,
+                  temperature[i] / 100, temperature[i] % 100);
+        } else {
+          /* A probe went missing, enumerate the bus again next time */
+          temperature_valid[i] = 0;
+          rep_cache_invalidate(&rep_cache[i]);
+          rescan = 1;
+          LOG_WARN("DS18B20 %d read failed, CRC errors %lu/%lu\n", i,
+                   (unsigned long)ds18b20_stats()->crc_errors,
+                   (unsigned long)ds18b20_stats()->reads);
+          TRACE(TRACE_SAMPLE_ERROR, i, ds18b20_stats()->crc_errors);
+        }
+      }
     } else {
-      printf("DS18B20 not detected!\n");
+      LOG_WARN("DS18B20 not detected!\n");
+      TRACE(TRACE_SAMPLE_ERROR, 0, -1);
+      rescan = 1;
     }
 
-    // etimer_reset(&et);
-    etimer_set(&et, SEND_INTERVAL); // Reset the timer for the next second
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
-    // etimer_set(&et, CLOCK_SECOND);
-      // PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER); // Wait for the end of the second
-      // etimer_set(&et, CLOCK_SECOND*3);
-      // etimer_set(&et, SEND_INTERVAL
-      // - CLOCK_SECOND + (random_rand() % (CLOCK_SECOND)));
-  // PROCESS_WAIT_UNTIL(etimer_expired(&periodic));
+    /* Next round in a window shared with the report */
+    wake_done(&sample_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event);
   }
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * A reading came back from a probe, good or not: a failed one still has
+ * READS and CRC_ERRORS to report
+ */
+static int
+sampled(void)
+{
+  int i;
+
+  for(i = 0; i < ds18b20_count(); i++) {
+    if(temperature_valid[i]) {
+      return 1;
+    }
+  }
+  return ds18b20_stats()->reads > 0;
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(udp_client_process, ev, data)
 {
-  static struct etimer periodic_timer;
-  static char str[128];
+  static uint8_t frame[FARM_FRAME_MAX_LEN];
+  farm_frame_writer_t writer;
   uip_ipaddr_t dest_ipaddr;
   static uint32_t tx_count;
   static uint32_t missed_tx_count;
+  int i;
 
   PROCESS_BEGIN();
 
   /* Initialize UDP connection */
   simple_udp_register(&udp_conn, UDP_CLIENT_PORT, NULL,
                       UDP_SERVER_PORT, udp_rx_callback);
+  backlog_init(&udp_conn);
+  energy_init();
+
+  for(i = 0; i < DS18B20_MAX_DEVICES; i++) {
+    report_channels[i].delta = WATER_TEMP_DELTA;
+  }
+  report_policy_init(&report_policy, report_channels,
+                     sizeof(report_channels) / sizeof(report_channels[0]),
+                     &udp_client_process);
+
+  wake_add_reporter(&report_job, &udp_client_process,
+                    node_config_report_windows());
+
+  /* No frame before there is a sample to put in it */
+  while(!sampled()) {
+    wake_restart(&report_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event || ev == PROCESS_EVENT_POLL);
+  }
 
-  etimer_set(&periodic_timer, random_rand() % SEND_INTERVAL);
   while(1) {
     // PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
 
+    farm_frame_begin(&writer, frame, sizeof(frame),
+                     FARM_MSG_TELEMETRY, FARM_NODE_WATER_TEMP);
+    backlog_put_seq(&writer);
+    /* All probes of the rack in one frame, each tagged with its index */
+    for(i = 0; i < ds18b20_count(); i++) {
+      if(temperature_valid[i]
+         && (!farm_frame_put_int(&writer, FARM_TLV_PROBE, i)
+             || !farm_frame_put_int(&writer, FARM_TLV_WATER_TEMP,
+                                    temperature[i]))) {
+        break;
+      }
+    }
+
+    /* Cumulative, so a frame too full to carry them loses nothing */
+    farm_frame_put_int(&writer, FARM_TLV_READS, ds18b20_stats()->reads);
+    farm_frame_put_int(&writer, FARM_TLV_CRC_ERRORS,
+                       ds18b20_stats()->crc_errors);
+
     if(NETSTACK_ROUTING.node_is_reachable() &&
         NETSTACK_ROUTING.get_root_ipaddr(&dest_ipaddr)) {
 
@@ -307,34 +471,36 @@ PROCESS_THREAD(udp_client_process, ev, data)
       LOG_INFO_("\n");      
 
 
-      snprintf(str, sizeof(str), "Temperature: %d\n",
-         temperature);      
-
-      simple_udp_sendto(&udp_conn, str, strlen(str), &dest_ipaddr);
+      /* Goes out behind any frames held while the node was away */
+      backlog_send(frame, farm_frame_len(&writer), &dest_ipaddr);
       tx_count++;
     } else {
-      LOG_INFO("Not reachable yet\n");
+      /* Held, not lost: sent in paced batches once the route is back */
+      backlog_put(frame, farm_frame_len(&writer));
+      LOG_INFO("Not reachable yet, %u frames held\n", backlog_count());
       if(tx_count > 0) {
         missed_tx_count++;   
       }   
     }
-    energest_flush();
-
-    printf("\nEnergest:\n");
-    printf(" CPU          %4lus LPM      %4lus DEEP LPM %4lus  Total time %lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_CPU)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_LPM)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_DEEP_LPM)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()));
-    printf(" Radio LISTEN %4lus TRANSMIT %4lus OFF      %4lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_LISTEN)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_TRANSMIT)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()
-                      - energest_type_time(ENERGEST_TYPE_TRANSMIT)
-                      - energest_type_time(ENERGEST_TYPE_LISTEN)));
-    /* Reset the timer */
-    etimer_set(&periodic_timer, SEND_INTERVAL);
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    report_policy_reported(&report_policy);
+    /* Energest of the period just reported, kept instead of printed */
+    energy_update();
+    res_energy.trigger();
+    energy_report(FARM_NODE_WATER_TEMP);
+
+    LOG_DBG("Reports %lu on change, %lu heartbeat\n",
+            (unsigned long)report_policy.change_reports,
+            (unsigned long)report_policy.heartbeat_reports);
+    LOG_DBG("Backlog %u held, %lu dropped, %lu resent\n",
+            backlog_count(), (unsigned long)backlog_dropped(),
+            (unsigned long)backlog_retransmitted());
+    LOG_DBG("Wake-ups %lu windows\n", (unsigned long)wake_windows());
+    /*
+     * Heartbeat in the shared wake-up window, the policy polls us in
+     * earlier when a value moves
+     */
+    wake_restart(&report_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event || ev == PROCESS_EVENT_POLL);
   }
 
   PROCESS_END();
@@ -0,0 +1,405 @@
+/**
+ * \file
+ *      Bit-banged 1-Wire driver for the DS18B20 water temperature probe.
+ */
+
+#include "ds18b20.h"
+#include "dev/gpio-hal.h"
+
+#include <string.h>
+
+#if DS18B20_RESOLUTION < DS18B20_RESOLUTION_MIN || DS18B20_RESOLUTION > DS18B20_RESOLUTION_MAX
+#error "DS18B20_RESOLUTION must be between 9 and 12 bits"
+#endif
+
+/* 750 ms max at 12 bits per the datasheet, with some margin */
+#define CONVERSION_TIME_MS_12BIT  800UL
+
+/* Configuration register: R1 R0 in bits 6-5, the other bits read as 1 */
+#define CONFIG_FROM_BITS(b)       ((((b) - 9) << 5) | 0x1F)
+#define CONFIG_TO_BITS(c)         ((((c) >> 5) & 0x03) + 9)
+
+/* Copy Scratchpad takes up to 10 ms to program the EEPROM */
+#define EEPROM_WRITE_US           10000UL
+
+extern gpio_hal_pin_t out_pin1;
+#if GPIO_HAL_PORT_PIN_NUMBERING
+extern gpio_hal_port_t out_port1;
+#endif
+
+/* Scratchpad layout */
+#define SP_TEMP_LSB               0
+#define SP_TEMP_MSB               1
+#define SP_TH                     2
+#define SP_TL                     3
+#define SP_CONFIG                 4
+#define SP_CRC                    8
+
+static uint8_t devices[DS18B20_MAX_DEVICES][DS18B20_ROM_LEN];
+static int device_count;
+static uint8_t resolution = DS18B20_RESOLUTION;
+static ds18b20_stats_t stats;
+
+/* Dallas/Maxim CRC8, x^8 + x^5 + x^4 + 1, reflected */
+static const uint8_t crc8_table[256] = {
+  0x00, 0x5e, 0xbc, 0xe2, 0x61, 0x3f, 0xdd, 0x83, 0xc2, 0x9c, 0x7e, 0x20,
+  0xa3, 0xfd, 0x1f, 0x41, 0x9d, 0xc3, 0x21, 0x7f, 0xfc, 0xa2, 0x40, 0x1e,
+  0x5f, 0x01, 0xe3, 0xbd, 0x3e, 0x60, 0x82, 0xdc, 0x23, 0x7d, 0x9f, 0xc1,
+  0x42, 0x1c, 0xfe, 0xa0, 0xe1, 0xbf, 0x5d, 0x03, 0x80, 0xde, 0x3c, 0x62,
+  0xbe, 0xe0, 0x02, 0x5c, 0xdf, 0x81, 0x63, 0x3d, 0x7c, 0x22, 0xc0, 0x9e,
+  0x1d, 0x43, 0xa1, 0xff, 0x46, 0x18, 0xfa, 0xa4, 0x27, 0x79, 0x9b, 0xc5,
+  0x84, 0xda, 0x38, 0x66, 0xe5, 0xbb, 0x59, 0x07, 0xdb, 0x85, 0x67, 0x39,
+  0xba, 0xe4, 0x06, 0x58, 0x19, 0x47, 0xa5, 0xfb, 0x78, 0x26, 0xc4, 0x9a,
+  0x65, 0x3b, 0xd9, 0x87, 0x04, 0x5a, 0xb8, 0xe6, 0xa7, 0xf9, 0x1b, 0x45,
+  0xc6, 0x98, 0x7a, 0x24, 0xf8, 0xa6, 0x44, 0x1a, 0x99, 0xc7, 0x25, 0x7b,
+  0x3a, 0x64, 0x86, 0xd8, 0x5b, 0x05, 0xe7, 0xb9, 0x8c, 0xd2, 0x30, 0x6e,
+  0xed, 0xb3, 0x51, 0x0f, 0x4e, 0x10, 0xf2, 0xac, 0x2f, 0x71, 0x93, 0xcd,
+  0x11, 0x4f, 0xad, 0xf3, 0x70, 0x2e, 0xcc, 0x92, 0xd3, 0x8d, 0x6f, 0x31,
+  0xb2, 0xec, 0x0e, 0x50, 0xaf, 0xf1, 0x13, 0x4d, 0xce, 0x90, 0x72, 0x2c,
+  0x6d, 0x33, 0xd1, 0x8f, 0x0c, 0x52, 0xb0, 0xee, 0x32, 0x6c, 0x8e, 0xd0,
+  0x53, 0x0d, 0xef, 0xb1, 0xf0, 0xae, 0x4c, 0x12, 0x91, 0xcf, 0x2d, 0x73,
+  0xca, 0x94, 0x76, 0x28, 0xab, 0xf5, 0x17, 0x49, 0x08, 0x56, 0xb4, 0xea,
+  0x69, 0x37, 0xd5, 0x8b, 0x57, 0x09, 0xeb, 0xb5, 0x36, 0x68, 0x8a, 0xd4,
+  0x95, 0xcb, 0x29, 0x77, 0xf4, 0xaa, 0x48, 0x16, 0xe9, 0xb7, 0x55, 0x0b,
+  0x88, 0xd6, 0x34, 0x6a, 0x2b, 0x75, 0x97, 0xc9, 0x4a, 0x14, 0xf6, 0xa8,
+  0x74, 0x2a, 0xc8, 0x96, 0x15, 0x4b, 0xa9, 0xf7, 0xb6, 0xe8, 0x0a, 0x54,
+  0xd7, 0x89, 0x6b, 0x35
+};
+
+/*---------------------------------------------------------------------------*/
+int
+DS18B20_Start(void)
+{
+  int response;
+
+  gpio_hal_arch_pin_set_output(out_port1, out_pin1);
+  gpio_hal_arch_write_pin(out_port1, out_pin1, 0);    /* reset pulse */
+  RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(480UL));
+
+  gpio_hal_arch_pin_set_input(out_port1, out_pin1);
+  RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(80UL));
+
+  /* The probe pulls the line low to signal its presence */
+  if(!gpio_hal_arch_read_pin(out_port1, out_pin1)) {
+    response = 1;
+  } else {
+    response = -1;
+  }
+
+  RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(400UL));          /* 480 us in total */
+  return response;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+crc8(const uint8_t *data, int len)
+{
+  uint8_t crc = 0;
+
+  while(len-- > 0) {
+    crc = crc8_table[crc ^ *data++];
+  }
+  return crc;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_bit(int bit)
+{
+  gpio_hal_arch_pin_set_output(out_port1, out_pin1);
+  gpio_hal_arch_write_pin(out_port1, out_pin1, 0);
+  if(bit) {
+    /* Write 1: release the line within 15 us */
+    RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(1UL));
+    gpio_hal_arch_pin_set_input(out_port1, out_pin1);
+    RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(50UL));
+  } else {
+    /* Write 0: hold the line for the whole slot */
+    RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(50UL));
+    gpio_hal_arch_pin_set_input(out_port1, out_pin1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_bit(void)
+{
+  int bit;
+
+  gpio_hal_arch_pin_set_output(out_port1, out_pin1);
+  gpio_hal_arch_write_pin(out_port1, out_pin1, 0);
+  RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(2UL));
+  gpio_hal_arch_pin_set_input(out_port1, out_pin1);
+  bit = gpio_hal_arch_read_pin(out_port1, out_pin1) ? 1 : 0;
+  RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(60UL));
+  return bit;
+}
+/*---------------------------------------------------------------------------*/
+void
+DS18B20_Write(uint8_t data)
+{
+  int i;
+
+  for(i = 0; i < 8; i++) {
+    write_bit(data & (1 << i));
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+DS18B20_Read(void)
+{
+  uint8_t value = 0;
+  int i;
+
+  for(i = 0; i < 8; i++) {
+    if(read_bit()) {
+      value |= (1 << i);
+    }
+  }
+  return value;
+}
+/*---------------------------------------------------------------------------*/
+/* Reset the bus and address a single probe, the bus is then ready for a
+   function command */
+static int
+select_device(int index)
+{
+  int i;
+
+  if(index < 0 || index >= device_count || DS18B20_Start() != 1) {
+    return 0;
+  }
+  DS18B20_Write(DS18B20_MATCH_ROM);
+  for(i = 0; i < DS18B20_ROM_LEN; i++) {
+    DS18B20_Write(devices[index][i]);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * One pass of the Search ROM algorithm (Maxim AN187). rom holds the code
+ * found by the previous pass and is overwritten with the next one, and
+ * last_discrepancy is the bit position where the previous pass took the
+ * 0 branch. Returns 0 when no probe answered or the bus glitched.
+ */
+static int
+search_next(uint8_t *rom, int *last_discrepancy)
+{
+  int bit_number;
+  int last_zero = 0;
+  int id_bit;
+  int cmp_id_bit;
+  int direction;
+  uint8_t mask;
+
+  if(DS18B20_Start() != 1) {
+    return 0;
+  }
+  DS18B20_Write(DS18B20_SEARCH_ROM);
+
+  for(bit_number = 1; bit_number <= DS18B20_ROM_LEN * 8; bit_number++) {
+    id_bit = read_bit();
+    cmp_id_bit = read_bit();
+    if(id_bit && cmp_id_bit) {
+      /* Nobody took part in this bit */
+      return 0;
+    }
+
+    mask = 1 << ((bit_number - 1) & 7);
+    if(id_bit != cmp_id_bit) {
+      /* Every remaining probe has the same bit here */
+      direction = id_bit;
+    } else {
+      /* Discrepancy: redo the old choice before the last branch point,
+         take the 1 branch at it and the 0 branch after it */
+      if(bit_number < *last_discrepancy) {
+        direction = (rom[(bit_number - 1) >> 3] & mask) != 0;
+      } else {
+        direction = (bit_number == *last_discrepancy);
+      }
+      if(!direction) {
+        last_zero = bit_number;
+      }
+    }
+
+    if(direction) {
+      rom[(bit_number - 1) >> 3] |= mask;
+    } else {
+      rom[(bit_number - 1) >> 3] &= ~mask;
+    }
+    write_bit(direction);
+  }
+
+  *last_discrepancy = last_zero;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+ds18b20_search(void)
+{
+  uint8_t rom[DS18B20_ROM_LEN];
+  int last_discrepancy = 0;
+
+  device_count = 0;
+  memset(rom, 0, sizeof(rom));
+
+  while(device_count < DS18B20_MAX_DEVICES
+        && search_next(rom, &last_discrepancy)) {
+    /* Other 1-Wire parts may share the bus, keep only the probes */
+    if(rom[0] == DS18B20_FAMILY_CODE
+       && crc8(rom, DS18B20_ROM_LEN - 1) == rom[DS18B20_ROM_LEN - 1]) {
+      memcpy(devices[device_count], rom, DS18B20_ROM_LEN);
+      device_count++;
+    }
+    if(last_discrepancy == 0) {
+      break;
+    }
+  }
+  return device_count;
+}
+/*---------------------------------------------------------------------------*/
+int
+ds18b20_count(void)
+{
+  return device_count;
+}
+/*---------------------------------------------------------------------------*/
+const uint8_t *
+ds18b20_rom(int index)
+{
+  if(index < 0 || index >= device_count) {
+    return NULL;
+  }
+  return devices[index];
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Read all 9 scratchpad bytes of one probe and check the CRC, retrying a
+ * few times on a bad read. A bus stuck low reads as all zeros, which has
+ * a valid CRC, so that is rejected too.
+ */
+static int
+read_scratchpad(int index, uint8_t *sp)
+{
+  int attempt;
+  int i;
+
+  for(attempt = 0; attempt <= DS18B20_READ_RETRIES; attempt++) {
+    if(!select_device(index)) {
+      break;
+    }
+    DS18B20_Write(DS18B20_READ_SCRATCHPAD);
+    for(i = 0; i < DS18B20_SCRATCHPAD_LEN; i++) {
+      sp[i] = DS18B20_Read();
+    }
+    stats.reads++;
+
+    if(crc8(sp, SP_CRC) == sp[SP_CRC] && sp[SP_CONFIG] != 0) {
+      return 1;
+    }
+    stats.crc_errors++;
+  }
+
+  stats.failures++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+ds18b20_convert(void)
+{
+  if(DS18B20_Start() != 1) {
+    return 0;
+  }
+  /* Skip ROM addresses every probe, they all convert in parallel */
+  DS18B20_Write(DS18B20_SKIP_ROM);
+  DS18B20_Write(DS18B20_CONVERT_T);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+ds18b20_conversion_time(void)
+{
+  unsigned long ms;
+
+  ms = CONVERSION_TIME_MS_12BIT >> (DS18B20_RESOLUTION_MAX - resolution);
+  return (clock_time_t)((ms * CLOCK_SECOND + 999) / 1000);
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_device_resolution(int index, uint8_t bits)
+{
+  uint8_t sp[DS18B20_SCRATCHPAD_LEN];
+
+  /* Never write back alarm bytes that came off a garbled read */
+  if(!read_scratchpad(index, sp)) {
+    return 0;
+  }
+  if(CONFIG_TO_BITS(sp[SP_CONFIG]) == bits) {
+    return 1;
+  }
+
+  if(!select_device(index)) {
+    return 0;
+  }
+  DS18B20_Write(DS18B20_WRITE_SCRATCHPAD);
+  DS18B20_Write(sp[SP_TH]);
+  DS18B20_Write(sp[SP_TL]);
+  DS18B20_Write(CONFIG_FROM_BITS(bits));
+
+  /* Save to EEPROM so the probe comes back at this resolution after a brown-out */
+  if(!select_device(index)) {
+    return 0;
+  }
+  DS18B20_Write(DS18B20_COPY_SCRATCHPAD);
+  RTIMER_BUSYWAIT(US_TO_RTIMERTICKS(EEPROM_WRITE_US));
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+ds18b20_set_resolution(uint8_t bits)
+{
+  int ok = 1;
+  int i;
+
+  if(bits < DS18B20_RESOLUTION_MIN || bits > DS18B20_RESOLUTION_MAX) {
+    return 0;
+  }
+
+  for(i = 0; i < device_count; i++) {
+    if(!set_device_resolution(i, bits)) {
+      ok = 0;
+    }
+  }
+
+  /* A probe that missed a lower setting still converts as slowly as before */
+  if(!ok && bits < resolution) {
+    return 0;
+  }
+  resolution = bits;
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+ds18b20_get_resolution(void)
+{
+  return resolution;
+}
+/*---------------------------------------------------------------------------*/
+int
+ds18b20_read_temperature(int index, int16_t *raw)
+{
+  uint8_t sp[DS18B20_SCRATCHPAD_LEN];
+
+  if(!read_scratchpad(index, sp)) {
+    return 0;
+  }
+  *raw = (int16_t)((sp[SP_TEMP_MSB] << 8) | sp[SP_TEMP_LSB]);
+
+  /* The low bits are undefined below 12-bit resolution */
+  *raw &= ~((1 << (DS18B20_RESOLUTION_MAX - resolution)) - 1);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+const ds18b20_stats_t *
+ds18b20_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
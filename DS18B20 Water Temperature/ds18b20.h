@@ -0,0 +1,132 @@
+/**
+ * \file
+ *      Bit-banged 1-Wire driver for DS18B20 water temperature probes.
+ *
+ *      Any number of probes can share the bus. ds18b20_search() fills a
+ *      device table with their ROM codes, ds18b20_convert() starts all of
+ *      them at once and each result is then read by table index with
+ *      Match ROM.
+ *
+ *      The driver never waits for a conversion itself. The caller starts
+ *      one with ds18b20_convert(), sleeps for ds18b20_conversion_time()
+ *      on an etimer and then collects the results, so the MCU can stay in
+ *      LPM and the network stack keeps running meanwhile.
+ */
+
+#ifndef DS18B20_H_
+#define DS18B20_H_
+
+#include "contiki.h"
+
+/* Resolution in bits (9-12), 12 is the power-on default of the probe */
+#ifdef DS18B20_CONF_RESOLUTION
+#define DS18B20_RESOLUTION        DS18B20_CONF_RESOLUTION
+#else
+#define DS18B20_RESOLUTION        12
+#endif
+
+#define DS18B20_RESOLUTION_MIN    9
+#define DS18B20_RESOLUTION_MAX    12
+
+/* Most probes kept in the device table */
+#ifdef DS18B20_CONF_MAX_DEVICES
+#define DS18B20_MAX_DEVICES       DS18B20_CONF_MAX_DEVICES
+#else
+#define DS18B20_MAX_DEVICES       8
+#endif
+
+/* Scratchpad reads retried after a CRC error before giving up */
+#ifdef DS18B20_CONF_READ_RETRIES
+#define DS18B20_READ_RETRIES      DS18B20_CONF_READ_RETRIES
+#else
+#define DS18B20_READ_RETRIES      2
+#endif
+
+#define DS18B20_ROM_LEN           8
+#define DS18B20_SCRATCHPAD_LEN    9
+#define DS18B20_FAMILY_CODE       0x28
+
+/* ROM commands */
+#define DS18B20_SEARCH_ROM        0xF0
+#define DS18B20_MATCH_ROM         0x55
+#define DS18B20_SKIP_ROM          0xCC
+
+/* Function commands */
+#define DS18B20_CONVERT_T         0x44
+#define DS18B20_WRITE_SCRATCHPAD  0x4E
+#define DS18B20_READ_SCRATCHPAD   0xBE
+#define DS18B20_COPY_SCRATCHPAD   0x48
+
+typedef struct ds18b20_stats {
+  uint32_t reads;             /* Scratchpad reads, retries included */
+  uint32_t crc_errors;        /* Reads that failed the CRC check */
+  uint32_t failures;          /* Readings given up after all retries */
+} ds18b20_stats_t;
+
+/* 1-Wire primitives */
+int DS18B20_Start(void);
+void DS18B20_Write(uint8_t data);
+uint8_t DS18B20_Read(void);
+
+/**
+ * \brief Enumerate the probes on the bus into the device table
+ * \return Number of probes found
+ *
+ * Probes are listed in ROM code order, so a table index stays with the
+ * same probe as long as no probe is added or removed.
+ */
+int ds18b20_search(void);
+
+/** \brief Number of probes in the device table */
+int ds18b20_count(void);
+
+/** \brief ROM code of probe index, DS18B20_ROM_LEN bytes, family code first */
+const uint8_t *ds18b20_rom(int index);
+
+/**
+ * \brief Start a temperature conversion on every probe at once
+ * \return 1 if a probe answered the reset pulse, 0 otherwise
+ */
+int ds18b20_convert(void);
+
+/**
+ * \brief Time to sleep between ds18b20_convert() and reading the result
+ *
+ * Halves with every bit of resolution given up, from 750 ms at 12 bits
+ * down to 94 ms at 9 bits, plus a small margin.
+ */
+clock_time_t ds18b20_conversion_time(void);
+
+/**
+ * \brief Set the conversion resolution of every probe in the table and
+ *        keep it across power cycles
+ * \param bits 9 to 12
+ * \return 1 on success, 0 if bits is out of range or a probe did not answer
+ *
+ * The configuration register is written with Write Scratchpad and saved
+ * to the probe EEPROM with Copy Scratchpad. The alarm registers are
+ * preserved, and nothing is written to a probe already running at bits.
+ * Must not be called while a conversion is in progress.
+ */
+int ds18b20_set_resolution(uint8_t bits);
+
+/** \brief Resolution used by the last conversion, in bits */
+uint8_t ds18b20_get_resolution(void);
+
+/**
+ * \brief Read the converted temperature of one probe
+ * \param index Position in the device table
+ * \param raw Result in 1/16 deg C, bits below the resolution are cleared
+ * \return 1 on success, 0 if the probe did not answer or every read
+ *         failed the CRC check
+ *
+ * The whole scratchpad is read and checked against its CRC byte. A bad
+ * read is retried up to DS18B20_READ_RETRIES times, which costs a few ms
+ * of bus time but no new conversion.
+ */
+int ds18b20_read_temperature(int index, int16_t *raw);
+
+/** \brief Bus error counters since boot */
+const ds18b20_stats_t *ds18b20_stats(void);
+
+#endif /* DS18B20_H_ */
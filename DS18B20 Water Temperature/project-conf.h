@@ -39,8 +39,12 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 
-#define LOG_LEVEL_APP LOG_LEVEL_DBG
+/* Log levels and trace ring, see build-profile.h */
+#include "build-profile.h"
 #define ENERGEST_CONF_ON 1
 
+/* 0.25 deg C steps are plenty for the reservoir and convert in 188 ms */
+#define DS18B20_CONF_RESOLUTION 10
+
 
 #endif /* PROJECT_CONF_H_ */
@@ -8,7 +8,16 @@
 #include "board-peripherals.h"
 #include "coap-engine.h"
 #include "coap.h"
-#include "sys/energest.h"
+#include "rep-cache.h"
+#include "cbor.h"
+#include "farm-frame.h"
+#include "report-policy.h"
+#include "backlog.h"
+#include "wake.h"
+#include "node-config.h"
+#include "energy.h"
+#include "proc-stats.h"
+#include "trace.h"
 #include <stdint.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -32,18 +41,25 @@
 #define UDP_CLIENT_PORT   8771
 #define UDP_SERVER_PORT   5678
 
-#define SEND_INTERVAL     (5 * 60 * CLOCK_SECOND)
 
 static struct simple_udp_connection udp_conn;
 static uint32_t rx_count = 0;
-static char str[128];
+static uint8_t frame[FARM_FRAME_MAX_LEN];
 
 #if BOARD_SENSORTAG
 extern coap_resource_t res_floatswitch;
 #endif
 
+/* Time the contact must stay put before a new level is believed */
+#define FLOAT_DEBOUNCE_TIME (CLOCK_SECOND / 20)
+
 static int float_switch_value;
-static int float_switch_detected_one = 0;
+/* Settled levels not reported yet, oldest first, so that a flap between
+   two reports goes out as two frames instead of none */
+#define FLOAT_LEVELS 4
+static uint8_t levels[FLOAT_LEVELS];
+static uint8_t levels_count;
+static gpio_hal_event_handler_t float_switch_handler;
 extern gpio_hal_pin_t out_pin1;
 
 #if GPIO_HAL_PORT_PIN_NUMBERING
@@ -52,6 +68,23 @@ extern gpio_hal_port_t out_port1;
 #define out_port1   GPIO_HAL_NULL_PORT
 #endif
 
+/* Every change of level is sent at once */
+static report_channel_t report_channels[] = {
+  REPORT_CHANNEL(1),
+};
+static report_policy_t report_policy;
+/* Jobs of the wake-up scheduler */
+static wake_job_t report_job;      /* Heartbeat */
+/* Intervals set over CoAP, kept across reboots */
+extern coap_resource_t res_config;
+/* Energest of the last report period */
+extern coap_resource_t res_energy;
+/* CPU time of each process, also the "procstats" shell command */
+extern coap_resource_t res_proc_stats;
+#if TRACE_ON
+/* Trace ring of the production build */
+extern coap_resource_t res_trace;
+#endif
 /*---------------------------------------------------------------------------*/
 
 PROCESS(udp_client_process, "UDP client");
@@ -64,12 +97,6 @@ void delay_ms(uint16_t ms) {
     clock_delay_usec(ms * 1000);
 }
 
-static unsigned long
-to_seconds(uint64_t time)
-{
-  return (unsigned long)(time / ENERGEST_SECOND);
-}
-
 static void
 udp_rx_callback(struct simple_udp_connection *c,
          const uip_ipaddr_t *sender_addr,
@@ -79,7 +106,11 @@ udp_rx_callback(struct simple_udp_connection *c,
          const uint8_t *data,
          uint16_t datalen)
 {
-  LOG_INFO("Received response '%.*s' from ", datalen, (char *) data);
+  /* The only answer from the border router is a telemetry ack */
+  if(!backlog_input(data, datalen)) {
+    return;
+  }
+  LOG_INFO("Received ack from ");
   LOG_INFO_6ADDR(sender_addr);
 #if LLSEC802154_CONF_ENABLED
   LOG_INFO_(" LLSEC LV:%d", uipbuf_get_attr(UIPBUF_ATTR_LLSEC_LEVEL));
@@ -88,49 +119,69 @@ udp_rx_callback(struct simple_udp_connection *c,
   rx_count++;
 }
 
+/* GET representations, encoded once per level change */
+static rep_cache_t rep_cache;
+static char rep_buf[160];
+
 static void 
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_event_handler(void);
 
 /* A simple getter example. Returns the reading from temp humid light sensor with a simple etag */
-RESOURCE(res_floatswitch,
-         "title=\"Floatswitch(supports JSON)\";rt=\"Floatswitch\"",
-         res_get_handler,
-         NULL,
-         NULL,
-         NULL);
+EVENT_RESOURCE(res_floatswitch,
+               "title=\"Floatswitch(supports JSON)\";rt=\"Floatswitch\";obs",
+               res_get_handler,
+               NULL,
+               NULL,
+               NULL,
+               res_event_handler);
+
+/* Fills rep_cache, at most once per level change */
+static int
+res_encode(char *buf, uint16_t size, unsigned int format, const void *ptr)
+{
+  cbor_writer_t w;
+
+  switch(format) {
+  case TEXT_PLAIN:
+    return snprintf(buf, size, "Float Switch: %d",
+                    float_switch_value);
+  case APPLICATION_XML:
+    return snprintf(buf, size,
+                    "<sensor><floatswitch val=\"%d\" unit=\"\"/></sensor>",
+                    float_switch_value);
+  case APPLICATION_JSON:
+    return snprintf(buf, size,
+                    "{\"sensor\":{\"Float Switch\":%d}}",
+                    float_switch_value);
+  case REP_CACHE_CBOR:
+    /* Keyed like the telemetry frame */
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_map(&w, 1);
+    cbor_put_uint(&w, FARM_TLV_FLOAT_SWITCH);
+    cbor_put_int(&w, float_switch_value);
+    return cbor_len(&w);
+  case REP_CACHE_SENML_CBOR:
+    cbor_init(&w, (uint8_t *)buf, size);
+    cbor_put_array(&w, 1);
+    senml_put_bool(&w, senml_base_name(), "floatswitch", float_switch_value);
+    return cbor_len(&w);
+  default:
+    return -1;
+  }
+}
 
 static void
 res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
 {
+  rep_cache_serve(&rep_cache, request, response, preferred_size, offset);
+}
 
-  unsigned int accept = -1;
-  coap_get_header_accept(request, &accept);
-
-  if (accept == -1 || accept == TEXT_PLAIN) {
-    coap_set_header_content_format(response, TEXT_PLAIN);
-    snprintf((char *)buffer, preferred_size, "Float Switch: %d", 
-             float_switch_value);
-
-    coap_set_payload(response, (uint8_t *)buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_XML) {
-    coap_set_header_content_format(response, APPLICATION_XML);
-    snprintf((char *)buffer, preferred_size, 
-             "<sensor><Float Switch val=\"%d\" unit=\" \"/>", 
-             float_switch_value);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else if (accept == APPLICATION_JSON) {
-    coap_set_header_content_format(response, APPLICATION_JSON);
-    snprintf((char *)buffer, preferred_size, 
-             "{\"sensor\":{\"Float Switch\":\"%d\"}", 
-             float_switch_value);
-
-    coap_set_payload(response, buffer, strlen((char *)buffer));
-  } else {
-    coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
-    const char *msg = "Supporting content-types text/plain, application/xml, and application/json";
-    coap_set_payload(response, msg, strlen(msg));
-  }
+/* Sends the current representation to every observer */
+static void
+res_event_handler(void)
+{
+  coap_notify_observers(&res_floatswitch);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -138,6 +189,17 @@ PROCESS_THREAD(er_example_server, ev, data)
 {
   PROCESS_BEGIN();
 
+  trace_init();
+
+  node_config_init(NULL, &report_job,
+                   NODE_CONFIG_SAMPLE_MIN,
+                   REPORT_POLICY_HEARTBEAT / CLOCK_SECOND);
+  proc_stats_attach(&er_example_server);
+  proc_stats_attach(&udp_client_process);
+  proc_stats_attach(&gpio_hal_example);
+
+  rep_cache_init(&rep_cache, rep_buf, sizeof(rep_buf), res_encode, NULL);
+
 
   PROCESS_PAUSE();
 
@@ -145,6 +207,12 @@ PROCESS_THREAD(er_example_server, ev, data)
 #if BOARD_SENSORTAG
   coap_activate_resource(&res_floatswitch, "builtinsensors/floatswitch");
 #endif
+  coap_activate_resource(&res_config, "config");
+  coap_activate_resource(&res_energy, "energy");
+  coap_activate_resource(&res_proc_stats, "procstats");
+#if TRACE_ON
+  coap_activate_resource(&res_trace, "trace");
+#endif
 
   /* Define application-specific events here. */
   while(1) {
@@ -163,51 +231,105 @@ PROCESS_THREAD(er_example_server, ev, data)
   PROCESS_END();
   }
 /*---------------------------------------------------------------------------*/
+/* Runs in interrupt context, hand over to the process */
+static void
+float_switch_edge(gpio_hal_port_t port, gpio_hal_pin_mask_t pin_mask)
+{
+  process_poll(&gpio_hal_example);
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(gpio_hal_example, ev, data)
 {
   static struct etimer et;
-  PROCESS_BEGIN();
+  int value;
 
-  etimer_set(&et, CLOCK_SECOND);
-  while(1) {
+  PROCESS_BEGIN();
 
-    // Wait for the timer to expire
+  gpio_hal_arch_pin_set_input(out_port1, out_pin1);
+  gpio_hal_arch_pin_cfg_set(out_port1, out_pin1,
+                            GPIO_HAL_PIN_CFG_EDGE_BOTH |
+                            GPIO_HAL_PIN_CFG_INT_ENABLE);
 
-    // Check the status of the float switch
-    gpio_hal_arch_pin_set_input(out_port1, out_pin1);
-    float_switch_value = gpio_hal_arch_read_pin(out_port1, out_pin1);
+  float_switch_handler.handler = float_switch_edge;
+  float_switch_handler.port = out_port1;
+  float_switch_handler.pin_mask = gpio_hal_pin_to_mask(out_pin1);
+  gpio_hal_register_handler(&float_switch_handler);
+  gpio_hal_arch_interrupt_enable(out_port1, out_pin1);
 
-    // snprintf(str, sizeof(str), "%d\n",
-    //     float_switch_value);  
-    if (float_switch_value == 1) {
-      float_switch_detected_one = 1;
-    }    
+  float_switch_value = gpio_hal_arch_read_pin(out_port1, out_pin1);
+  LOG_INFO_("Float switch value: %d\n", float_switch_value);
+  /* The level can change at any time, so no Max-Age, only the ETag */
+  rep_cache_update(&rep_cache, 0);
 
-    LOG_INFO_("Float switch value: %d\n", float_switch_value);
-    etimer_set(&et, CLOCK_SECOND);    
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));    
+  /* Nothing runs between edges, so the node can stay in deep LPM */
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+    /* Every further edge while the contact bounces restarts the wait */
+    do {
+      etimer_set(&et, FLOAT_DEBOUNCE_TIME);
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&et));
+    } while(ev == PROCESS_EVENT_POLL);
+
+    value = gpio_hal_arch_read_pin(out_port1, out_pin1);
+    if(value != float_switch_value) {
+      float_switch_value = value;
+      LOG_INFO_("Float switch value: %d\n", float_switch_value);
+      rep_cache_update(&rep_cache, 0);
+      /* Every settled change is worth a notification */
+      res_floatswitch.trigger();
+
+      if(levels_count < FLOAT_LEVELS) {
+        levels[levels_count++] = value;
+      } else {
+        /* Bouncing faster than the radio, the newest level wins */
+        levels[FLOAT_LEVELS - 1] = value;
+      }
+      /* Report the new level right away instead of at the next interval */
+      report_policy_sample(&report_policy, 0, float_switch_value);
+    }
   }
 
   PROCESS_END();
-}  
+}
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(udp_client_process, ev, data)
 {
-  static struct etimer periodic_timer;
   uip_ipaddr_t dest_ipaddr;
   static uint32_t tx_count;
   static uint32_t missed_tx_count;
+  farm_frame_writer_t writer;
+  int level;
 
   PROCESS_BEGIN();
 
   /* Initialize UDP connection */
   simple_udp_register(&udp_conn, UDP_CLIENT_PORT, NULL,
                       UDP_SERVER_PORT, udp_rx_callback);
+  backlog_init(&udp_conn);
+  energy_init();
 
-  etimer_set(&periodic_timer, SEND_INTERVAL);
+  report_policy_init(&report_policy, report_channels,
+                     sizeof(report_channels) / sizeof(report_channels[0]),
+                     &udp_client_process);
+
+  wake_add_reporter(&report_job, &udp_client_process,
+                    node_config_report_windows());
   while(1) {
     // PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
 
+    farm_frame_begin(&writer, frame, sizeof(frame),
+                     FARM_MSG_TELEMETRY, FARM_NODE_FLOAT_SWITCH);
+    backlog_put_seq(&writer);
+    /* One queued level per frame, the current one on a heartbeat */
+    level = float_switch_value;
+    if(levels_count > 0) {
+      level = levels[0];
+      levels_count--;
+      memmove(levels, &levels[1], levels_count);
+    }
+    farm_frame_put_int(&writer, FARM_TLV_FLOAT_SWITCH, level);
+
     if(NETSTACK_ROUTING.node_is_reachable() &&
         NETSTACK_ROUTING.get_root_ipaddr(&dest_ipaddr)) {
 
@@ -222,38 +344,40 @@ PROCESS_THREAD(udp_client_process, ev, data)
       LOG_INFO_6ADDR(&dest_ipaddr);
       LOG_INFO_("\n");      
 
-      // gpio_hal_arch_pin_set_input(out_port1, out_pin1);
-      // float_switch_value = gpio_hal_arch_read_pin(out_port1, out_pin1);
-
-      // LOG_INFO_("Float switch value: %d\n", float_switch_value);
-      snprintf(str, sizeof(str), "%d\n", float_switch_detected_one);
-      float_switch_detected_one = 0;  // Reset for the next interval    
-
-      simple_udp_sendto(&udp_conn, str, strlen(str), &dest_ipaddr);
+      /* Goes out behind any frames held while the node was away */
+      backlog_send(frame, farm_frame_len(&writer), &dest_ipaddr);
       tx_count++;
     } else {
-      LOG_INFO("Not reachable yet\n");
+      /* Held, not lost: sent in paced batches once the route is back */
+      backlog_put(frame, farm_frame_len(&writer));
+      LOG_INFO("Not reachable yet, %u frames held\n", backlog_count());
       if(tx_count > 0) {
         missed_tx_count++;   
       }   
     }
-    energest_flush();
-
-    printf("\nEnergest:\n");
-    printf(" CPU          %4lus LPM      %4lus DEEP LPM %4lus  Total time %lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_CPU)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_LPM)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_DEEP_LPM)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()));
-    printf(" Radio LISTEN %4lus TRANSMIT %4lus OFF      %4lus\n",
-           to_seconds(energest_type_time(ENERGEST_TYPE_LISTEN)),
-           to_seconds(energest_type_time(ENERGEST_TYPE_TRANSMIT)),
-           to_seconds(ENERGEST_GET_TOTAL_TIME()
-                      - energest_type_time(ENERGEST_TYPE_TRANSMIT)
-                      - energest_type_time(ENERGEST_TYPE_LISTEN)));
-    /* Reset the timer */
-    etimer_set(&periodic_timer, SEND_INTERVAL);
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    report_policy_reported(&report_policy);
+    /* Energest of the period just reported, kept instead of printed */
+    energy_update();
+    res_energy.trigger();
+    energy_report(FARM_NODE_FLOAT_SWITCH);
+
+    LOG_DBG("Reports %lu on change, %lu heartbeat\n",
+            (unsigned long)report_policy.change_reports,
+            (unsigned long)report_policy.heartbeat_reports);
+    LOG_DBG("Backlog %u held, %lu dropped, %lu resent\n",
+            backlog_count(), (unsigned long)backlog_dropped(),
+            (unsigned long)backlog_retransmitted());
+    LOG_DBG("Wake-ups %lu windows\n", (unsigned long)wake_windows());
+    /* The rest of a flap goes out right behind */
+    if(levels_count > 0) {
+      process_poll(&udp_client_process);
+    }
+    /*
+     * Heartbeat in the shared wake-up window, the policy polls us in
+     * earlier when a value moves
+     */
+    wake_restart(&report_job);
+    PROCESS_WAIT_EVENT_UNTIL(ev == wake_event || ev == PROCESS_EVENT_POLL);
   }
 
   PROCESS_END();
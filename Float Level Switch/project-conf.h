@@ -39,8 +39,12 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 
-#define LOG_LEVEL_APP LOG_LEVEL_DBG
+/* Log levels and trace ring, see build-profile.h */
+#include "build-profile.h"
 #define ENERGEST_CONF_ON 1
 
+/* The float switch is an alarm, its edges are never held back */
+#define REPORT_POLICY_CONF_MIN_INTERVAL 0
+
 
 #endif /* PROJECT_CONF_H_ */
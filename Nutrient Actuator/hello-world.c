@@ -4,6 +4,7 @@
 #include "random.h"
 #include "net/netstack.h"
 #include "net/ipv6/simple-udp.h"
+#include "farm-frame.h"
 #include "board-peripherals.h"
 #include <stdint.h>
 #include <inttypes.h>
@@ -23,6 +24,8 @@
 #define UDP_SERVER_PORT   5678
 
 #define SEND_INTERVAL     (5 * 60 * CLOCK_SECOND)
+/* Poll faster until the border router has sent a first command */
+#define REGISTER_INTERVAL (10 * CLOCK_SECOND)
 
 extern gpio_hal_pin_t out_pin1;
 extern gpio_hal_pin_t out_pin2;
@@ -42,7 +45,6 @@ extern gpio_hal_port_t out_port2;
 static struct simple_udp_connection udp_conn;
 static uint32_t rx_count = 0;
 static clock_time_t send_time;
-static int response_value;
 static struct etimer delay_timer;
 
 /*---------------------------------------------------------------------------*/
@@ -75,28 +77,60 @@ udp_rx_callback(struct simple_udp_connection *c,
          const uint8_t *data,
          uint16_t datalen)
 {
-  if (datalen == sizeof(response_value)) {
-    memcpy(&response_value, data, sizeof(response_value));
-    LOG_INFO("Received response '%d' from ", response_value);
-    LOG_INFO_6ADDR(sender_addr);
-    LOG_INFO_("\n");
-    rx_count++;
-    if (response_value == 0) {
-      gpio_operation_end();
-      LOG_INFO("RESPONSE 0");
-    }  
-    else if (response_value == 1) {
-      gpio_operation_start();    
+  static int32_t last_command_id = -1;
+  static int32_t last_state = -1;
+  static uint8_t ack[FARM_FRAME_MAX_LEN];
+  farm_frame_reader_t reader;
+  farm_frame_writer_t writer;
+  farm_tlv_t tlv;
+  int32_t command_id = -1;
+  int32_t state = -1;
+
+  if(!farm_frame_open(&reader, data, datalen)
+     || reader.msg_type != FARM_MSG_COMMAND) {
+    return;
+  }
+  while(farm_frame_next(&reader, &tlv)) {
+    if(tlv.type == FARM_TLV_COMMAND_ID) {
+      farm_tlv_int(&tlv, &command_id);
+    } else if(tlv.type == FARM_TLV_ACTUATOR_STATE) {
+      farm_tlv_int(&tlv, &state);
+    }
+  }
+  if(state < 0) {
+    return;
+  }
+
+  LOG_INFO("Received command %ld, state %ld from ", (long)command_id, (long)state);
+  LOG_INFO_6ADDR(sender_addr);
+  LOG_INFO_("\n");
+  rx_count++;
+
+  /* A retransmission whose ack got lost is acked again, not applied twice */
+  if(command_id != last_command_id || state != last_state) {
+    last_command_id = command_id;
+    last_state = state;
+    if(state & FARM_ACTUATOR_PUMP) {
+      gpio_operation_start();
       process_start(&delay_process, NULL);
-      LOG_INFO("RESPONSE 1");
+      LOG_INFO("RESPONSE 1\n");
+    } else {
+      gpio_operation_end();
+      LOG_INFO("RESPONSE 0\n");
     }
   }
+
+  farm_frame_begin(&writer, ack, sizeof(ack), FARM_MSG_ACK, FARM_NODE_NUTRIENT_PUMP);
+  farm_frame_put_int(&writer, FARM_TLV_COMMAND_ID, command_id);
+  farm_frame_put_int(&writer, FARM_TLV_ACTUATOR_STATE, state);
+  simple_udp_sendto(&udp_conn, ack, farm_frame_len(&writer), sender_addr);
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(udp_client_process, ev, data)
 {
   static struct etimer periodic_timer;
-  static char str[128];
+  static uint8_t frame[FARM_FRAME_MAX_LEN];
+  farm_frame_writer_t writer;
   uip_ipaddr_t dest_ipaddr;
   static uint32_t tx_count;
   static uint32_t missed_tx_count;
@@ -107,7 +141,7 @@ PROCESS_THREAD(udp_client_process, ev, data)
   simple_udp_register(&udp_conn, UDP_CLIENT_PORT, NULL,
                       UDP_SERVER_PORT, udp_rx_callback);
 
-  etimer_set(&periodic_timer, SEND_INTERVAL);
+  etimer_set(&periodic_timer, REGISTER_INTERVAL);
   while(1) {
     PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));    
 
@@ -123,11 +157,12 @@ PROCESS_THREAD(udp_client_process, ev, data)
       LOG_INFO_6ADDR(&dest_ipaddr);
       LOG_INFO_("\n");      
       
-      snprintf(str, sizeof(str), "%d\n", 1);          
+      farm_frame_begin(&writer, frame, sizeof(frame),
+                       FARM_MSG_POLL, FARM_NODE_NUTRIENT_PUMP);
 
       send_time = clock_time();      
 
-      simple_udp_sendto(&udp_conn, str, strlen(str), &dest_ipaddr);
+      simple_udp_sendto(&udp_conn, frame, farm_frame_len(&writer), &dest_ipaddr);
       tx_count++;
     } else {
       LOG_INFO("Not reachable yet\n");
@@ -137,7 +172,7 @@ PROCESS_THREAD(udp_client_process, ev, data)
     }
 
     /* Reset the timer */
-    etimer_set(&periodic_timer, SEND_INTERVAL);
+    etimer_set(&periodic_timer, rx_count > 0 ? SEND_INTERVAL : REGISTER_INTERVAL);
   }
 
   PROCESS_END();
@@ -3,9 +3,15 @@
 #include "net/routing/routing.h"
 #include "net/netstack.h"
 #include "net/ipv6/simple-udp.h"
+#include "farm-frame.h"
+#include "node-table.h"
+#include "farm-dispatch.h"
+#include "actuator-push.h"
+#include "rule-engine.h"
 #include <stdio.h>
 #include "random.h"
 #include <stdlib.h>
+#include <string.h>
 
 #include "sys/log.h"
 #define LOG_MODULE "App"
@@ -14,186 +20,253 @@
 #define WITH_SERVER_REPLY  1
 #define UDP_SERVER_PORT 5678
 
-// ENVIRONMENT SENSORS
-#define UDP_CLIENT_PORT_1 8765  // TEMP, HUMID, LIGHT
-
-// WATER SENSORS
-#define UDP_CLIENT_PORT_3 8768  // DS18B20
-#define UDP_CLIENT_PORT_4 8769  // ec sensor
-#define UDP_CLIENT_PORT_5 8770  // ph sensor
-#define UDP_CLIENT_PORT_6 8771  // float switch
-
-
-// ACTUATORS
-#define UDP_CLIENT_PORT_2 8766 // NUTRIENT PUMP
-#define UDP_CLIENT_PORT_7 8772 // GROW LIGHT & WATER PUMP
-
-
-static struct simple_udp_connection udp_conn_1; // For client port 8765
-static struct simple_udp_connection udp_conn_2; // For client port 8766
-static struct simple_udp_connection udp_conn_3; // For client port 8768
-static struct simple_udp_connection udp_conn_4; // For client port 8769
-static struct simple_udp_connection udp_conn_5; // For client port 8770
-static struct simple_udp_connection udp_conn_6; // For client port 8771
-static struct simple_udp_connection udp_conn_7; // For client port 8772
-
-
-
-static int temperature, humidity, light;
-static int water_temp, ec_sensor, float_switch;
-static char ph_char[128];
+/* printf() arguments of part / whole in percent with two decimals */
+#define DUTY_CYCLE(part, whole) \
+  (unsigned long)((part) * 10000 / (whole) / 100), \
+  (unsigned long)((part) * 10000 / (whole) % 100)
+
+/*
+ * Control policy. Light is in 0.01 lux: the grow light comes on below
+ * 50 lux and goes off above 60 lux, and stays in each state for at
+ * least a minute. A low float switch (1) runs both water pumps.
+ */
+static const farm_rule_t control_rules[] = {
+  /* Light as soon as the darkest bed needs it */
+  { FARM_TLV_LIGHT, RULE_INPUT_MIN, RULE_ON_BELOW, 5000, 6000,
+    FARM_NODE_GROWLIGHT, FARM_ACTUATOR_GROWLIGHT,
+    60 * CLOCK_SECOND, 60 * CLOCK_SECOND },
+  /* Pumps while any float switch reads low */
+  { FARM_TLV_FLOAT_SWITCH, RULE_INPUT_MAX, RULE_ON_ABOVE, 0, 1,
+    FARM_NODE_GROWLIGHT, FARM_ACTUATOR_PUMP, 0, 0 },
+  { FARM_TLV_FLOAT_SWITCH, RULE_INPUT_MAX, RULE_ON_ABOVE, 0, 1,
+    FARM_NODE_NUTRIENT_PUMP, FARM_ACTUATOR_PUMP, 0, 0 },
+};
 
 PROCESS(rpl_border_router_process, "RPL Border Router Process");
 AUTOSTART_PROCESSES(&rpl_border_router_process);
 
 /*---------------------------------------------------------------------------*/
-// 
+/* Duty cycles since the node was first seen, once its last record is in */
 static void
-udp_rx_callback_1(struct simple_udp_connection *c,
-         const uip_ipaddr_t *sender_addr,
-         uint16_t sender_port,
-         const uip_ipaddr_t *receiver_addr,
-         uint16_t receiver_port,
-         const uint8_t *data,
-         uint16_t datalen)
+energy_input(const node_energy_t *e, uint8_t type)
 {
+  uint64_t period = e->sum[0];
 
-  // LOG_INFO("RX Callback 1 UDP packet received from ");
-  // LOG_INFO_6ADDR(sender_addr);
-  // LOG_INFO_(" on port %d from port %d with length %d\n", receiver_port, sender_port, datalen);
-
-    // Use sscanf to parse the string and extract the values
-  sscanf((char *) data, "Temperature: %d, Humidity: %d, Light: %d", &temperature, &humidity, &light);
-    // Now you have the individual values stored in the variables temperature, humidity, and light
-  temperature = temperature / 100;
-  humidity = humidity / 100;
-  light = light / 100;
-
-  printf("Temperature: %d deg Celsius\n", temperature);
-  printf("Humidity: %d RH\n", humidity);
-  printf("Light: %d centilux\n", light);
-
-
+  if(type != FARM_TLV_ENERGY_TRANSMIT || period == 0) {
+    return;
+  }
+  printf("Energy over %lu s: CPU %lu.%02lu%%, radio listen %lu.%02lu%%, transmit %lu.%02lu%%\n",
+         (unsigned long)(period / FARM_ENERGY_SECOND),
+         DUTY_CYCLE(e->sum[FARM_TLV_ENERGY_CPU - FARM_TLV_ENERGY_PERIOD], period),
+         DUTY_CYCLE(e->sum[FARM_TLV_ENERGY_LISTEN - FARM_TLV_ENERGY_PERIOD], period),
+         DUTY_CYCLE(e->sum[FARM_TLV_ENERGY_TRANSMIT - FARM_TLV_ENERGY_PERIOD], period));
 }
-
-static void //NUTRIENT PUMP
-udp_rx_callback_2(struct simple_udp_connection *c,  
-         const uip_ipaddr_t *sender_addr,
-         uint16_t sender_port,
-         const uip_ipaddr_t *receiver_addr,
-         uint16_t receiver_port,
-         const uint8_t *data,
-         uint16_t datalen)
+/*---------------------------------------------------------------------------*/
+static farm_node_t *
+telemetry_input(const uip_ipaddr_t *sender_addr, farm_frame_reader_t *frame)
 {
-  static int response_value_nutrientpump;
-  if (float_switch == 1) {
-      response_value_nutrientpump = 1;
-      simple_udp_sendto(&udp_conn_2, &response_value_nutrientpump, sizeof(response_value_nutrientpump), sender_addr);
+  farm_tlv_t tlv;
+  farm_node_t *node;
+  node_energy_t *energy;
+  int32_t value;
+  int32_t age = 0;
+  int16_t boot = -1;
+  uint8_t probe = 0;
+
+  node = node_table_add(sender_addr, frame->node_class);
+  if(node == NULL) {
+    LOG_WARN("Node table full, ignoring ");
+    LOG_WARN_6ADDR(sender_addr);
+    LOG_WARN_("\n");
+    return NULL;
   }
-  else if (float_switch == 0) {
-      response_value_nutrientpump = 0;
-      simple_udp_sendto(&udp_conn_2, &response_value_nutrientpump, sizeof(response_value_nutrientpump), sender_addr);
+  node->last_seen = clock_time();
+
+  LOG_INFO("Telemetry from ");
+  LOG_INFO_6ADDR(sender_addr);
+  LOG_INFO_("\n");
+
+  while(farm_frame_next(frame, &tlv)) {
+    if(!farm_tlv_int(&tlv, &value)) {
+      continue;
+    }
+
+    /* Comes before the seq, which it tells apart across restarts */
+    if(tlv.type == FARM_TLV_BOOT) {
+      boot = (int16_t)value;
+      continue;
+    }
+
+    /* Retransmissions and late copies are counted, not processed again */
+    if(tlv.type == FARM_TLV_SEQ) {
+      if(!node_table_seq(node, (uint16_t)value, boot)) {
+        LOG_INFO("Duplicate frame %u\n", (uint16_t)value);
+        return node;
+      }
+      node->rx_frames++;
+      printf("Frame %u, %lu received %lu lost\n", (uint16_t)value,
+             (unsigned long)node->seq_received,
+             (unsigned long)node->seq_lost);
+      continue;
+    }
+
+    /* Multi-probe nodes put the probe index in front of each reading */
+    if(tlv.type == FARM_TLV_PROBE) {
+      probe = (uint8_t)value;
+      continue;
+    }
+
+    /* The age leads a frame held on the node, whose readings are only
+       logged: they must not override the live ones or drive the rules */
+    if(tlv.type == FARM_TLV_AGE) {
+      age = value;
+      printf("Held %ld s on the node\n", (long)age);
+      continue;
+    }
+
+    /* Energy adds up whether it was held or not */
+    if(tlv.type >= FARM_TLV_ENERGY_PERIOD &&
+       tlv.type < FARM_TLV_ENERGY_PERIOD + FARM_TLV_ENERGY_RECORDS) {
+      energy = node_table_energy(node);
+      if(energy != NULL) {
+        energy->sum[tlv.type - FARM_TLV_ENERGY_PERIOD] += (uint32_t)value;
+        energy_input(energy, tlv.type);
+      }
+      continue;
+    }
+
+    if(age == 0 &&
+       node_table_update(node, tlv.type, probe, value) == NULL) {
+      LOG_WARN("No channel slot left for type %u\n", tlv.type);
+      probe = 0;
+      continue;
+    }
+
+    /* Window statistics are kept in the table, rules see the latest value */
+    if(tlv.type & FARM_TLV_STAT_MASK) {
+      printf("  %s: %ld\n",
+             (tlv.type & FARM_TLV_STAT_MASK) == FARM_TLV_MIN(0) ? "min" :
+             (tlv.type & FARM_TLV_STAT_MASK) == FARM_TLV_MAX(0) ? "max" : "mean",
+             (long)value);
+      probe = 0;
+      continue;
+    }
+
+    /* Rules reading this channel push any new decision right away */
+    if(age == 0) {
+      rule_engine_input(tlv.type, node->last_seen);
+    }
+
+    switch(tlv.type) {
+    case FARM_TLV_TEMPERATURE:
+      printf("Temperature: %d deg Celsius\n", (int)(value / 100));
+      break;
+    case FARM_TLV_HUMIDITY:
+      printf("Humidity: %d RH\n", (int)(value / 100));
+      break;
+    case FARM_TLV_LIGHT:
+      printf("Light: %d centilux\n", (int)(value / 100));
+      break;
+    case FARM_TLV_WATER_TEMP:
+      printf("Water Temperature %u: %d deg Celsius\n", probe, (int)(value / 100));
+      break;
+    case FARM_TLV_EC:
+      printf("eC level: %d uS/cm \n", (int)value);
+      break;
+    case FARM_TLV_PH:
+      printf("ph level: %d.%03d\n", (int)(value / 1000), (int)(value % 1000));
+      break;
+    case FARM_TLV_FLOAT_SWITCH:
+      printf("water level: %d\n", (int)value);
+      break;
+    case FARM_TLV_READS:
+      printf("Sensor reads: %ld\n", (long)value);
+      break;
+    case FARM_TLV_CRC_ERRORS:
+      printf("Sensor CRC errors: %ld\n", (long)value);
+      break;
+    case FARM_TLV_WINDOW_SAMPLES:
+      printf("Window samples: %ld\n", (long)value);
+      break;
+    default:
+      /* Newer node firmware, skip what we do not know */
+      break;
+    }
+    probe = 0;
   }
+  return node;
 }
-
+/*---------------------------------------------------------------------------*/
+/* Tell the node which of its frames arrived, once per datagram */
 static void
-udp_rx_callback_3(struct simple_udp_connection *c,
-         const uip_ipaddr_t *sender_addr,
-         uint16_t sender_port,
-         const uip_ipaddr_t *receiver_addr,
-         uint16_t receiver_port,
-         const uint8_t *data,
-         uint16_t datalen)
+send_telemetry_ack(const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+                   const farm_node_t *node)
 {
+#if FARM_TELEMETRY_ACK
+  uint8_t ack[FARM_FRAME_HDR_LEN + 2 * (FARM_FRAME_TLV_HDR_LEN + 4)];
+  farm_frame_writer_t w;
+  uint32_t received;
+  uint16_t seq;
+
+  if(node == NULL || !node->seq_valid) {
+    return;
+  }
 
-    sscanf((char *) data, "Temperature: %d", &water_temp);
-    printf("Water Temperature: %d deg Celsius\n", water_temp);
-
+  seq = node_table_seq_ack(node, &received);
+  farm_frame_begin(&w, ack, sizeof(ack), FARM_MSG_TELEMETRY_ACK,
+                   node->node_class);
+  farm_frame_put_seq(&w, FARM_TLV_SEQ, seq);
+  if(received != 0) {
+    farm_frame_put_int(&w, FARM_TLV_SEQ_RECEIVED, (int32_t)received);
+  }
+  farm_dispatch_send(sender_addr, sender_port, ack, farm_frame_len(&w));
+#endif /* FARM_TELEMETRY_ACK */
 }
+/*---------------------------------------------------------------------------*/
 static void
-udp_rx_callback_4(struct simple_udp_connection *c,
-         const uip_ipaddr_t *sender_addr,
-         uint16_t sender_port,
-         const uip_ipaddr_t *receiver_addr,
-         uint16_t receiver_port,
-         const uint8_t *data,
-         uint16_t datalen)
+handle_telemetry(const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+                 farm_frame_reader_t *frame)
 {
-
-
-    sscanf((char *) data, "%d", &ec_sensor);
-    printf("eC level: %d uS/cm \n", ec_sensor);
+  send_telemetry_ack(sender_addr, sender_port,
+                     telemetry_input(sender_addr, frame));
 }
+/*---------------------------------------------------------------------------*/
 static void
-udp_rx_callback_5(struct simple_udp_connection *c,
-         const uip_ipaddr_t *sender_addr,
-         uint16_t sender_port,
-         const uip_ipaddr_t *receiver_addr,
-         uint16_t receiver_port,
-         const uint8_t *data,
-         uint16_t datalen)
+handle_poll(const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+            farm_frame_reader_t *frame)
 {
-
-  if (datalen < sizeof(ph_char)) {
-    memcpy(ph_char, data, datalen);
-    ph_char[datalen] = '\0'; // Null-terminate the string
-  } else {
-    memcpy(ph_char, data, sizeof(ph_char) - 1);
-    ph_char[sizeof(ph_char) - 1] = '\0'; // Null-terminate the string
+  /* A poll registers the actuator and resends its current state */
+  if(actuator_push_register(sender_addr, sender_port,
+                            frame->node_class) != NULL) {
+    actuator_push_set(frame->node_class,
+                      rule_engine_output(frame->node_class), clock_time());
   }
-  printf("ph level: %s\n", ph_char);
 }
 
 static void
-udp_rx_callback_6(struct simple_udp_connection *c,
-         const uip_ipaddr_t *sender_addr,
-         uint16_t sender_port,
-         const uip_ipaddr_t *receiver_addr,
-         uint16_t receiver_port,
-         const uint8_t *data,
-         uint16_t datalen)
+handle_batch(const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+             farm_frame_reader_t *frame)
 {
-
-    sscanf((char *) data, "%d", &float_switch);
-    printf("water level: %d\n", float_switch);
+  farm_frame_reader_t held;
+  farm_tlv_t tlv;
+  farm_node_t *node = NULL;
+
+  /* Frames a node held while it had no route, oldest first */
+  while(farm_frame_next(frame, &tlv)) {
+    if(tlv.type == FARM_TLV_FRAME
+       && farm_frame_open(&held, tlv.value, tlv.len)
+       && held.msg_type == FARM_MSG_TELEMETRY) {
+      node = telemetry_input(sender_addr, &held);
+    }
+  }
+  send_telemetry_ack(sender_addr, sender_port, node);
 }
-
-static void //GROW LIGHT & WATER PUMP
-udp_rx_callback_7(struct simple_udp_connection *c,  
-         const uip_ipaddr_t *sender_addr,
-         uint16_t sender_port,
-         const uip_ipaddr_t *receiver_addr,
-         uint16_t receiver_port,
-         const uint8_t *data,
-         uint16_t datalen)
+/*---------------------------------------------------------------------------*/
+static void
+handle_ack(const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+           farm_frame_reader_t *frame)
 {
-
-  static int response_value;
-  if ((light < 50) && (float_switch == 0)){
-      LOG_INFO("Insufficient light, Grow light is turned ON\n");
-      LOG_INFO("Water Level High\n");
-      response_value = 2; //10
-      simple_udp_sendto(&udp_conn_7, &response_value, sizeof(response_value), sender_addr);
-  }
-  else if ((light > 50) && (float_switch == 0)){
-      LOG_INFO("Sufficient light, Grow light is turned OFF\n");
-      LOG_INFO("Water Level High\n");      
-      response_value = 0; //00
-      simple_udp_sendto(&udp_conn_7, &response_value, sizeof(response_value), sender_addr);
-  }
-  else if ((light < 50) && (float_switch == 1)){
-      LOG_INFO("Insufficient light, Grow light is turned ON\n");
-      LOG_INFO("Water Level Low, Adding Hydroponics Solution \n");
-      response_value = 3; //11
-      simple_udp_sendto(&udp_conn_7, &response_value, sizeof(response_value), sender_addr);
-  }  
-  else if ((light > 50) && (float_switch == 1)){
-      LOG_INFO("Sufficient light, Grow light is turned OFF\n");
-      LOG_INFO("Water Level Low, Adding Hydroponics Solution \n");
-      response_value = 1; //01
-      simple_udp_sendto(&udp_conn_7, &response_value, sizeof(response_value), sender_addr);
-  }    
-
+  actuator_push_ack(sender_addr, frame);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -211,20 +284,18 @@ PROCESS_THREAD(rpl_border_router_process, ev, data)
   /* Initialize RPL */
   NETSTACK_ROUTING.root_start();
 
-  /* Initialize UDP connections */
-  simple_udp_register(&udp_conn_1, UDP_SERVER_PORT, NULL,
-                      UDP_CLIENT_PORT_1, udp_rx_callback_1);
-  simple_udp_register(&udp_conn_2, UDP_SERVER_PORT, NULL,
-                      UDP_CLIENT_PORT_2, udp_rx_callback_2);
-  simple_udp_register(&udp_conn_3, UDP_SERVER_PORT, NULL,
-                      UDP_CLIENT_PORT_3, udp_rx_callback_3);   
-  simple_udp_register(&udp_conn_4, UDP_SERVER_PORT, NULL,
-                      UDP_CLIENT_PORT_4, udp_rx_callback_4);                                           
-  simple_udp_register(&udp_conn_5, UDP_SERVER_PORT, NULL,
-                      UDP_CLIENT_PORT_5, udp_rx_callback_5);
-  simple_udp_register(&udp_conn_6, UDP_SERVER_PORT, NULL,
-                      UDP_CLIENT_PORT_6, udp_rx_callback_6);                      
-  simple_udp_register(&udp_conn_7, UDP_SERVER_PORT, NULL,
-                      UDP_CLIENT_PORT_7, udp_rx_callback_7);    
+  node_table_init();
+  actuator_push_init();
+  if(!rule_engine_init(control_rules,
+                       sizeof(control_rules) / sizeof(control_rules[0]))) {
+    LOG_ERR("Rule table does not fit the engine, no rules run\n");
+  }
+
+  /* One listener for all nodes, handlers picked by message type */
+  farm_dispatch_init(UDP_SERVER_PORT);
+  farm_dispatch_register(FARM_MSG_TELEMETRY, handle_telemetry);
+  farm_dispatch_register(FARM_MSG_POLL, handle_poll);
+  farm_dispatch_register(FARM_MSG_ACK, handle_ack);
+  farm_dispatch_register(FARM_MSG_BATCH, handle_batch);
   PROCESS_END();
 }
@@ -0,0 +1,201 @@
+/**
+ * \file
+ *      Push actuator commands from the border router.
+ */
+
+#include "actuator-push.h"
+#include "farm-dispatch.h"
+#include "sys/ctimer.h"
+
+#include <string.h>
+
+#include "sys/log.h"
+#define LOG_MODULE "Actuator"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+static actuator_t actuators[ACTUATOR_PUSH_MAX];
+
+static void send_command(actuator_t *a);
+/*---------------------------------------------------------------------------*/
+static actuator_t *
+find(const uip_ipaddr_t *addr)
+{
+  int i;
+
+  for(i = 0; i < ACTUATOR_PUSH_MAX; i++) {
+    if(actuators[i].node_class != 0
+       && uip_ipaddr_cmp(&actuators[i].addr, addr)) {
+      return &actuators[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+retry_timeout(void *ptr)
+{
+  actuator_t *a = ptr;
+
+  if(a->acked == a->desired) {
+    return;
+  }
+
+  if(a->retries >= ACTUATOR_PUSH_MAX_RETRIES) {
+    a->timeouts++;
+    LOG_WARN("No ack for command %u from ", a->command_id);
+    LOG_WARN_6ADDR(&a->addr);
+    LOG_WARN_(", waiting for its next poll\n");
+    return;
+  }
+
+  a->retries++;
+  send_command(a);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_command(actuator_t *a)
+{
+  uint8_t buf[FARM_FRAME_MAX_LEN];
+  farm_frame_writer_t w;
+
+  farm_frame_begin(&w, buf, sizeof(buf), FARM_MSG_COMMAND, a->node_class);
+  farm_frame_put_int(&w, FARM_TLV_COMMAND_ID, a->command_id);
+  farm_frame_put_int(&w, FARM_TLV_ACTUATOR_STATE, a->desired);
+
+  farm_dispatch_send(&a->addr, a->port, buf, farm_frame_len(&w));
+  ctimer_set(&a->retry_timer, ACTUATOR_PUSH_ACK_TIMEOUT, retry_timeout, a);
+}
+/*---------------------------------------------------------------------------*/
+void
+actuator_push_init(void)
+{
+  memset(actuators, 0, sizeof(actuators));
+}
+/*---------------------------------------------------------------------------*/
+actuator_t *
+actuator_push_register(const uip_ipaddr_t *addr, uint16_t port,
+                       uint8_t node_class)
+{
+  actuator_t *a;
+  int i;
+
+  a = find(addr);
+  for(i = 0; a == NULL && i < ACTUATOR_PUSH_MAX; i++) {
+    if(actuators[i].node_class == 0) {
+      a = &actuators[i];
+      memset(a, 0, sizeof(*a));
+      uip_ipaddr_copy(&a->addr, addr);
+      a->desired = -1;
+      LOG_INFO("Registered actuator ");
+      LOG_INFO_6ADDR(addr);
+      LOG_INFO_("\n");
+    }
+  }
+  if(a == NULL) {
+    LOG_WARN("Actuator table full, ignoring ");
+    LOG_WARN_6ADDR(addr);
+    LOG_WARN_("\n");
+    return NULL;
+  }
+
+  a->port = port;
+  a->node_class = node_class;
+  a->acked = -1;
+  return a;
+}
+/*---------------------------------------------------------------------------*/
+void
+actuator_push_set(uint8_t node_class, int32_t state, clock_time_t sensed_at)
+{
+  actuator_t *a;
+
+  for(a = actuator_push_head(); a != NULL; a = actuator_push_next(a)) {
+    if(a->node_class != node_class || a->acked == state) {
+      continue;
+    }
+
+    /* A command for this state is already on its way */
+    if(a->desired == state && !ctimer_expired(&a->retry_timer)) {
+      continue;
+    }
+
+    if(a->desired != state) {
+      a->sensed_at = sensed_at;
+    }
+    a->desired = state;
+    a->command_id++;
+    a->retries = 0;
+    send_command(a);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+actuator_push_ack(const uip_ipaddr_t *sender_addr, farm_frame_reader_t *frame)
+{
+  actuator_t *a;
+  farm_tlv_t tlv;
+  int32_t id = -1;
+  int32_t state = -1;
+  clock_time_t latency;
+
+  a = find(sender_addr);
+  if(a == NULL) {
+    return;
+  }
+
+  while(farm_frame_next(frame, &tlv)) {
+    if(tlv.type == FARM_TLV_COMMAND_ID) {
+      farm_tlv_int(&tlv, &id);
+    } else if(tlv.type == FARM_TLV_ACTUATOR_STATE) {
+      farm_tlv_int(&tlv, &state);
+    }
+  }
+
+  /* Late acks of superseded commands tell us nothing */
+  if(id != a->command_id || state != a->desired) {
+    return;
+  }
+
+  ctimer_stop(&a->retry_timer);
+  if(a->acked == state) {
+    return;
+  }
+  a->acked = state;
+
+  latency = clock_time() - a->sensed_at;
+  a->last_latency = latency;
+  a->max_latency = MAX(a->max_latency, latency);
+  a->latency_sum += latency;
+  a->acks++;
+
+  LOG_INFO("Actuator ");
+  LOG_INFO_6ADDR(&a->addr);
+  LOG_INFO_(" now in state %ld, sense-to-actuate %lu ms (max %lu ms)\n",
+            (long)state,
+            (unsigned long)(latency * 1000 / CLOCK_SECOND),
+            (unsigned long)(a->max_latency * 1000 / CLOCK_SECOND));
+}
+/*---------------------------------------------------------------------------*/
+static actuator_t *
+first_from(actuator_t *a)
+{
+  for(; a < &actuators[ACTUATOR_PUSH_MAX]; a++) {
+    if(a->node_class != 0) {
+      return a;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+actuator_t *
+actuator_push_head(void)
+{
+  return first_from(&actuators[0]);
+}
+/*---------------------------------------------------------------------------*/
+actuator_t *
+actuator_push_next(actuator_t *a)
+{
+  return first_from(a + 1);
+}
+/*---------------------------------------------------------------------------*/
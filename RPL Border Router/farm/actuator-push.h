@@ -0,0 +1,86 @@
+/**
+ * \file
+ *      Push actuator commands from the border router as soon as the
+ *      control decision changes, and track their acknowledgements.
+ *
+ *      Actuators register by polling. From then on every change of the
+ *      desired state is sent right away and retried until the actuator
+ *      acks it. The time from the sample that caused the change to the
+ *      ack is kept as the sense-to-actuate latency.
+ */
+
+#ifndef ACTUATOR_PUSH_H_
+#define ACTUATOR_PUSH_H_
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+#include "farm-frame.h"
+
+#ifdef ACTUATOR_PUSH_CONF_MAX
+#define ACTUATOR_PUSH_MAX         ACTUATOR_PUSH_CONF_MAX
+#else
+#define ACTUATOR_PUSH_MAX         8
+#endif
+
+/* Time to wait for an ack before sending the command again */
+#ifdef ACTUATOR_PUSH_CONF_ACK_TIMEOUT
+#define ACTUATOR_PUSH_ACK_TIMEOUT ACTUATOR_PUSH_CONF_ACK_TIMEOUT
+#else
+#define ACTUATOR_PUSH_ACK_TIMEOUT (CLOCK_SECOND / 2)
+#endif
+
+#ifdef ACTUATOR_PUSH_CONF_MAX_RETRIES
+#define ACTUATOR_PUSH_MAX_RETRIES ACTUATOR_PUSH_CONF_MAX_RETRIES
+#else
+#define ACTUATOR_PUSH_MAX_RETRIES 4
+#endif
+
+typedef struct actuator {
+  struct ctimer retry_timer;
+  uip_ipaddr_t addr;
+  uint16_t port;
+  uint8_t node_class;         /* FARM_NODE_*, 0 when the slot is free */
+  uint8_t command_id;
+  uint8_t retries;
+  int32_t desired;
+  int32_t acked;              /* -1 until the actuator confirms a state */
+  clock_time_t sensed_at;     /* Arrival of the sample behind desired */
+
+  /* Sense-to-actuate latency, in clock ticks */
+  clock_time_t last_latency;
+  clock_time_t max_latency;
+  uint32_t latency_sum;
+  uint16_t acks;
+  uint16_t timeouts;
+} actuator_t;
+
+void actuator_push_init(void);
+
+/**
+ * \brief Remember an actuator that polled, so it gets future pushes
+ * \return The actuator, NULL if the table is full
+ *
+ * A poll may come from a rebooted actuator, so its acked state is
+ * forgotten and the next actuator_push_set() resends the command.
+ */
+actuator_t *actuator_push_register(const uip_ipaddr_t *addr, uint16_t port,
+                                   uint8_t node_class);
+
+/**
+ * \brief Set the state wanted for every actuator of a class
+ * \param sensed_at Arrival time of the sample that led to the decision
+ *
+ * Only actuators whose confirmed state differs get a command.
+ */
+void actuator_push_set(uint8_t node_class, int32_t state,
+                       clock_time_t sensed_at);
+
+/** \brief Handle a FARM_MSG_ACK frame */
+void actuator_push_ack(const uip_ipaddr_t *sender_addr,
+                       farm_frame_reader_t *frame);
+
+/* Iterate registered actuators */
+actuator_t *actuator_push_head(void);
+actuator_t *actuator_push_next(actuator_t *a);
+
+#endif /* ACTUATOR_PUSH_H_ */
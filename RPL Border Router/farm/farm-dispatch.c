@@ -0,0 +1,69 @@
+/**
+ * \file
+ *      One UDP listener for every farm node.
+ */
+
+#include "farm-dispatch.h"
+#include "net/ipv6/simple-udp.h"
+
+#include "sys/log.h"
+#define LOG_MODULE "Dispatch"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+static struct simple_udp_connection udp_conn;
+static farm_dispatch_handler_t handlers[FARM_DISPATCH_MAX_TYPES];
+
+/*---------------------------------------------------------------------------*/
+static void
+udp_rx_callback(struct simple_udp_connection *c,
+                const uip_ipaddr_t *sender_addr,
+                uint16_t sender_port,
+                const uip_ipaddr_t *receiver_addr,
+                uint16_t receiver_port,
+                const uint8_t *data,
+                uint16_t datalen)
+{
+  farm_frame_reader_t frame;
+
+  if(!farm_frame_open(&frame, data, datalen)) {
+    LOG_WARN("Dropping malformed frame (%u bytes) from ", datalen);
+    LOG_WARN_6ADDR(sender_addr);
+    LOG_WARN_("\n");
+    return;
+  }
+
+  if(frame.msg_type >= FARM_DISPATCH_MAX_TYPES
+     || handlers[frame.msg_type] == NULL) {
+    LOG_WARN("No handler for message type %u from ", frame.msg_type);
+    LOG_WARN_6ADDR(sender_addr);
+    LOG_WARN_("\n");
+    return;
+  }
+
+  handlers[frame.msg_type](sender_addr, sender_port, &frame);
+}
+/*---------------------------------------------------------------------------*/
+void
+farm_dispatch_init(uint16_t local_port)
+{
+  /* Remote port 0 lets datagrams from every node class in */
+  simple_udp_register(&udp_conn, local_port, NULL, 0, udp_rx_callback);
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_dispatch_register(uint8_t msg_type, farm_dispatch_handler_t handler)
+{
+  if(msg_type >= FARM_DISPATCH_MAX_TYPES) {
+    return 0;
+  }
+  handlers[msg_type] = handler;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_dispatch_send(const uip_ipaddr_t *addr, uint16_t port,
+                   const void *data, uint16_t len)
+{
+  return simple_udp_sendto_port(&udp_conn, data, len, addr, port);
+}
+/*---------------------------------------------------------------------------*/
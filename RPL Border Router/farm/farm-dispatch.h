@@ -0,0 +1,45 @@
+/**
+ * \file
+ *      One UDP listener for every farm node, with handlers looked up by
+ *      the message type of the received frame.
+ *
+ *      Adding a node class only means registering a handler; it does not
+ *      cost a port, a simple_udp connection or a callback of its own.
+ */
+
+#ifndef FARM_DISPATCH_H_
+#define FARM_DISPATCH_H_
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+#include "farm-frame.h"
+
+/* Message types are looked up directly, keep them below this */
+#ifdef FARM_DISPATCH_CONF_MAX_TYPES
+#define FARM_DISPATCH_MAX_TYPES   FARM_DISPATCH_CONF_MAX_TYPES
+#else
+#define FARM_DISPATCH_MAX_TYPES   8
+#endif
+
+/**
+ * A handler gets the frame already opened, so its records are known to
+ * be in bounds.
+ */
+typedef void (*farm_dispatch_handler_t)(const uip_ipaddr_t *sender_addr,
+                                        uint16_t sender_port,
+                                        farm_frame_reader_t *frame);
+
+/** \brief Open the listener on local_port, accepting any remote port */
+void farm_dispatch_init(uint16_t local_port);
+
+/**
+ * \brief Route frames of msg_type to handler, replacing any previous one
+ * \return 1 on success, 0 if msg_type is out of range
+ */
+int farm_dispatch_register(uint8_t msg_type, farm_dispatch_handler_t handler);
+
+/** \brief Send a datagram to a node through the shared listener */
+int farm_dispatch_send(const uip_ipaddr_t *addr, uint16_t port,
+                       const void *data, uint16_t len);
+
+#endif /* FARM_DISPATCH_H_ */
@@ -0,0 +1,322 @@
+/**
+ * \file
+ *      Per-node sensor state for the border router.
+ */
+
+#include "node-table.h"
+#include "farm-frame.h"
+#include "lib/memb.h"
+
+#include <string.h>
+
+#if (NODE_TABLE_BUCKETS & (NODE_TABLE_BUCKETS - 1)) != 0
+#error "NODE_TABLE_BUCKETS must be a power of two"
+#endif
+
+MEMB(node_memb, farm_node_t, NODE_TABLE_SIZE);
+MEMB(channel_memb, node_channel_t, NODE_TABLE_CHANNEL_POOL);
+#if NODE_TABLE_ENERGY_SIZE > 0
+MEMB(energy_memb, node_energy_t, NODE_TABLE_ENERGY_SIZE);
+#endif
+
+static farm_node_t *buckets[NODE_TABLE_BUCKETS];
+static node_channel_t *by_type[NODE_TABLE_INDEXED_TYPES];
+static int node_count;
+static uint32_t overflow_count;
+static uint32_t channel_overflow_count;
+
+/*---------------------------------------------------------------------------*/
+static unsigned
+bucket_of(const uip_ipaddr_t *addr)
+{
+  unsigned h = 0;
+  int i;
+
+  /* All farm nodes share the DODAG prefix, only the IID tells them apart */
+  for(i = 8; i < sizeof(uip_ipaddr_t); i++) {
+    h = h * 31 + addr->u8[i];
+  }
+  return h & (NODE_TABLE_BUCKETS - 1);
+}
+/*---------------------------------------------------------------------------*/
+void
+node_table_init(void)
+{
+  memb_init(&node_memb);
+  memb_init(&channel_memb);
+#if NODE_TABLE_ENERGY_SIZE > 0
+  memb_init(&energy_memb);
+#endif
+  memset(buckets, 0, sizeof(buckets));
+  memset(by_type, 0, sizeof(by_type));
+  node_count = 0;
+  overflow_count = 0;
+  channel_overflow_count = 0;
+}
+/*---------------------------------------------------------------------------*/
+farm_node_t *
+node_table_lookup(const uip_ipaddr_t *addr)
+{
+  farm_node_t *n;
+
+  for(n = buckets[bucket_of(addr)]; n != NULL; n = n->next) {
+    if(uip_ipaddr_cmp(&n->addr, addr)) {
+      return n;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+farm_node_t *
+node_table_add(const uip_ipaddr_t *addr, uint8_t node_class)
+{
+  farm_node_t *n;
+  unsigned b;
+
+  n = node_table_lookup(addr);
+  if(n != NULL) {
+    n->node_class = node_class;
+    return n;
+  }
+
+  n = memb_alloc(&node_memb);
+  if(n == NULL) {
+    overflow_count++;
+    return NULL;
+  }
+
+  memset(n, 0, sizeof(*n));
+  uip_ipaddr_copy(&n->addr, addr);
+  n->node_class = node_class;
+
+  b = bucket_of(addr);
+  n->next = buckets[b];
+  buckets[b] = n;
+  node_count++;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+unlink_type(node_channel_t *ch)
+{
+  node_channel_t **pp;
+
+  if(ch->type >= NODE_TABLE_INDEXED_TYPES) {
+    return;
+  }
+  for(pp = &by_type[ch->type]; *pp != NULL; pp = &(*pp)->type_next) {
+    if(*pp == ch) {
+      *pp = ch->type_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+node_table_remove(farm_node_t *node)
+{
+  farm_node_t **pp;
+  node_channel_t *ch;
+
+  for(pp = &buckets[bucket_of(&node->addr)]; *pp != NULL; pp = &(*pp)->next) {
+    if(*pp == node) {
+      *pp = node->next;
+      while((ch = node->channels) != NULL) {
+        node->channels = ch->next;
+        unlink_type(ch);
+        memb_free(&channel_memb, ch);
+      }
+#if NODE_TABLE_ENERGY_SIZE > 0
+      if(node->energy != NULL) {
+        memb_free(&energy_memb, node->energy);
+      }
+#endif
+      memb_free(&node_memb, node);
+      node_count--;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+node_channel_t *
+node_table_channel(farm_node_t *node, uint8_t type, uint8_t probe)
+{
+  node_channel_t *ch;
+
+  for(ch = node->channels; ch != NULL; ch = ch->next) {
+    if(ch->type == type && ch->probe == probe) {
+      return ch;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+node_channel_t *
+node_table_first_of(uint8_t type)
+{
+  if(type >= NODE_TABLE_INDEXED_TYPES) {
+    return NULL;
+  }
+  return by_type[type];
+}
+/*---------------------------------------------------------------------------*/
+node_channel_t *
+node_table_update(farm_node_t *node, uint8_t type, uint8_t probe,
+                  int32_t value)
+{
+  node_channel_t *ch;
+
+  ch = node_table_channel(node, type, probe);
+  if(ch == NULL) {
+    /* First sample of this channel, claim a slot from the pool */
+    if(node->channel_count >= NODE_TABLE_CHANNELS) {
+      return NULL;
+    }
+    ch = memb_alloc(&channel_memb);
+    if(ch == NULL) {
+      channel_overflow_count++;
+      return NULL;
+    }
+    memset(ch, 0, sizeof(*ch));
+    ch->type = type;
+    ch->probe = probe;
+    ch->next = node->channels;
+    node->channels = ch;
+    node->channel_count++;
+    if(type < NODE_TABLE_INDEXED_TYPES) {
+      ch->type_next = by_type[type];
+      by_type[type] = ch;
+    }
+  }
+
+  ch->value = value;
+  ch->updated = clock_time();
+  ch->samples++;
+  return ch;
+}
+/*---------------------------------------------------------------------------*/
+node_energy_t *
+node_table_energy(farm_node_t *node)
+{
+#if NODE_TABLE_ENERGY_SIZE > 0
+  if(node->energy == NULL) {
+    node->energy = memb_alloc(&energy_memb);
+    if(node->energy != NULL) {
+      memset(node->energy, 0, sizeof(*node->energy));
+    }
+  }
+#endif
+  return node->energy;
+}
+/*---------------------------------------------------------------------------*/
+int
+node_table_seq(farm_node_t *node, uint16_t seq, int16_t boot)
+{
+  int16_t d = farm_seq_diff(seq, node->seq);
+  int restarted = boot >= 0 && boot != node->boot;
+
+  if(boot >= 0) {
+    node->boot = (uint8_t)boot;
+  }
+
+  /* Seq 0 only stands for a restart from nodes that send no boot count,
+     otherwise a late copy of it would be counted twice */
+  if(!node->seq_valid || restarted || (seq == 0 && boot < 0) ||
+     d <= -NODE_TABLE_SEQ_WINDOW) {
+    /* Everything before the first frame counts as received */
+    node->seq = seq;
+    node->seq_window = 0xffffffffUL;
+    node->seq_valid = 1;
+    node->seq_received++;
+    return 1;
+  }
+
+  if(d > 0) {
+    /* The frames in between are lost until they turn up late */
+    node->seq_lost += d - 1;
+    node->seq_window = d < NODE_TABLE_SEQ_WINDOW
+      ? (node->seq_window << d) | 1 : 1;
+    node->seq = seq;
+    node->seq_received++;
+    return 1;
+  }
+
+  if(node->seq_window & (1UL << -d)) {
+    node->seq_duplicates++;
+    return 0;
+  }
+  node->seq_window |= 1UL << -d;
+  node->seq_lost--;
+  node->seq_received++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+node_table_seq_ack(const farm_node_t *node, uint32_t *received)
+{
+  int oldest;
+  int i;
+
+  /* The oldest frame still missing inside the window */
+  for(oldest = NODE_TABLE_SEQ_WINDOW - 1; oldest > 0; oldest--) {
+    if(!(node->seq_window & (1UL << oldest))) {
+      break;
+    }
+  }
+
+  *received = 0;
+  if(oldest == 0) {
+    return node->seq;
+  }
+  for(i = 0; i < oldest; i++) {
+    if(node->seq_window & (1UL << i)) {
+      *received |= 1UL << (oldest - i);
+    }
+  }
+  return node->seq - oldest - 1;
+}
+/*---------------------------------------------------------------------------*/
+static farm_node_t *
+first_from(unsigned b)
+{
+  for(; b < NODE_TABLE_BUCKETS; b++) {
+    if(buckets[b] != NULL) {
+      return buckets[b];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+farm_node_t *
+node_table_head(void)
+{
+  return first_from(0);
+}
+/*---------------------------------------------------------------------------*/
+farm_node_t *
+node_table_next(farm_node_t *node)
+{
+  if(node->next != NULL) {
+    return node->next;
+  }
+  return first_from(bucket_of(&node->addr) + 1);
+}
+/*---------------------------------------------------------------------------*/
+int
+node_table_count(void)
+{
+  return node_count;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+node_table_overflows(void)
+{
+  return overflow_count;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+node_table_channel_overflows(void)
+{
+  return channel_overflow_count;
+}
+/*---------------------------------------------------------------------------*/
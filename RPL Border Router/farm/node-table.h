@@ -0,0 +1,173 @@
+/**
+ * \file
+ *      Per-node sensor state for the border router, keyed by the IPv6
+ *      source address of the node.
+ *
+ *      Entries come from a fixed MEMB pool and are chained into a hash
+ *      table, so lookup and insert cost the same with 5 or 500 nodes.
+ *      Nothing is allocated at run time and a full table refuses new
+ *      nodes instead of evicting known ones.
+ *
+ *      The channels of all nodes share one pool, so a float switch with
+ *      one channel does not hold the 13 slots of an environment node. The
+ *      energy sums of the nodes that send them are kept in a separate,
+ *      smaller table. On a 32-bit target a node entry is 56 bytes, a
+ *      channel 20 and the energy sums 48, each with a byte of pool count,
+ *      and a bucket is 4. The 64-node default with 4 channels per node
+ *      and 8 energy entries takes about 9.5 kB; 512 nodes with 2 channels
+ *      each take about 52 kB, more than is left next to the stack on an
+ *      80 kB CC1352R LaunchPad.
+ */
+
+#ifndef NODE_TABLE_H_
+#define NODE_TABLE_H_
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+#include "farm-frame.h"
+
+#ifdef NODE_TABLE_CONF_SIZE
+#define NODE_TABLE_SIZE           NODE_TABLE_CONF_SIZE
+#else
+#define NODE_TABLE_SIZE           64
+#endif
+
+/* Must be a power of two, keep it at or above NODE_TABLE_SIZE */
+#ifdef NODE_TABLE_CONF_BUCKETS
+#define NODE_TABLE_BUCKETS        NODE_TABLE_CONF_BUCKETS
+#else
+#define NODE_TABLE_BUCKETS        64
+#endif
+
+/* Most channels one node may hold (an environment node with last, min,
+   max and mean of 3 channels and the window sample count) */
+#ifdef NODE_TABLE_CONF_CHANNELS
+#define NODE_TABLE_CHANNELS       NODE_TABLE_CONF_CHANNELS
+#else
+#define NODE_TABLE_CHANNELS       13
+#endif
+
+/* Channels of all nodes together */
+#ifdef NODE_TABLE_CONF_CHANNEL_POOL
+#define NODE_TABLE_CHANNEL_POOL   NODE_TABLE_CONF_CHANNEL_POOL
+#else
+#define NODE_TABLE_CHANNEL_POOL   (NODE_TABLE_SIZE * 4)
+#endif
+
+/* Nodes whose energy records are summed, 0 to leave them out */
+#ifdef NODE_TABLE_CONF_ENERGY_SIZE
+#define NODE_TABLE_ENERGY_SIZE    NODE_TABLE_CONF_ENERGY_SIZE
+#else
+#define NODE_TABLE_ENERGY_SIZE    8
+#endif
+
+/* Channels of a type below this are also chained across nodes by type,
+   see node_table_first_of() */
+#define NODE_TABLE_INDEXED_TYPES  16
+
+typedef struct node_channel {
+  struct node_channel *next;  /* Next channel of the same node */
+  struct node_channel *type_next; /* Next channel of the same type */
+  int32_t value;
+  clock_time_t updated;
+  uint16_t samples;
+  uint8_t type;               /* FARM_TLV_* */
+  uint8_t probe;              /* FARM_TLV_PROBE index, 0 for single sensors */
+} node_channel_t;
+
+/* Sums of the FARM_TLV_ENERGY_* records since the node was first seen,
+   in 1/FARM_ENERGY_SECOND s, indexed from FARM_TLV_ENERGY_PERIOD */
+typedef struct node_energy {
+  uint64_t sum[FARM_TLV_ENERGY_RECORDS];
+} node_energy_t;
+
+/* Late frames are still recognised this many sequence numbers back */
+#define NODE_TABLE_SEQ_WINDOW     32
+
+typedef struct farm_node {
+  struct farm_node *next;     /* Hash bucket chain */
+  uip_ipaddr_t addr;
+  node_channel_t *channels;   /* From the shared pool */
+  node_energy_t *energy;      /* NULL until the first energy record */
+  clock_time_t last_seen;
+  uint32_t seq_window;        /* Bit n set: frame seq - n arrived */
+  uint32_t seq_received;      /* Distinct telemetry frames */
+  uint32_t seq_lost;          /* Frames missing from the sequence */
+  uint32_t seq_duplicates;
+  uint16_t seq;               /* Newest sequence number */
+  uint16_t rx_frames;         /* Telemetry frames taken in, not duplicates */
+  uint8_t seq_valid;
+  uint8_t boot;               /* FARM_TLV_BOOT of the newest frame */
+  uint8_t node_class;         /* FARM_NODE_* */
+  uint8_t channel_count;
+} farm_node_t;
+
+void node_table_init(void);
+
+/**
+ * \brief Account for a telemetry frame with sequence number seq
+ * \param boot FARM_TLV_BOOT of the frame, -1 if it has none
+ * \return 1 if the frame is new, 0 if it is a duplicate
+ *
+ * A new boot count, a frame more than NODE_TABLE_SEQ_WINDOW behind, or
+ * sequence number 0 in a frame without a boot count starts a new count:
+ * the node restarted. The boot count catches a restart whose first
+ * frames were lost, which the sequence number alone would take for late
+ * frames or duplicates.
+ */
+int node_table_seq(farm_node_t *node, uint16_t seq, int16_t boot);
+
+/**
+ * \brief Cumulative ack for a node
+ * \param received Set to the FARM_TLV_SEQ_RECEIVED bits for the frames
+ *                 that arrived after the cumulative ack
+ * \return Newest sequence number up to which nothing is missing
+ */
+uint16_t node_table_seq_ack(const farm_node_t *node, uint32_t *received);
+
+/** \brief Find a node, NULL if it was never seen */
+farm_node_t *node_table_lookup(const uip_ipaddr_t *addr);
+
+/** \brief Find a node or add it, NULL only when the pool is exhausted */
+farm_node_t *node_table_add(const uip_ipaddr_t *addr, uint8_t node_class);
+
+void node_table_remove(farm_node_t *node);
+
+/**
+ * \brief Store a new sample of one channel
+ * \return The updated channel, NULL if the node holds NODE_TABLE_CHANNELS
+ *         already or the channel pool is exhausted
+ */
+node_channel_t *node_table_update(farm_node_t *node, uint8_t type,
+                                  uint8_t probe, int32_t value);
+
+/**
+ * \brief First channel of a type over all nodes, follow type_next for
+ *        the rest
+ * \return NULL if no node reported it or type is not below
+ *         NODE_TABLE_INDEXED_TYPES
+ */
+node_channel_t *node_table_first_of(uint8_t type);
+
+/** \brief Latest state of one channel of a node, NULL if never reported */
+node_channel_t *node_table_channel(farm_node_t *node, uint8_t type,
+                                   uint8_t probe);
+
+/**
+ * \brief Energy sums of a node, taken from the energy table on first use
+ * \return NULL if the energy table is full or NODE_TABLE_ENERGY_SIZE is 0
+ */
+node_energy_t *node_table_energy(farm_node_t *node);
+
+/* Iterate all nodes, in no particular order */
+farm_node_t *node_table_head(void);
+farm_node_t *node_table_next(farm_node_t *node);
+
+int node_table_count(void);
+/** \brief Number of nodes refused because the pool was full */
+uint32_t node_table_overflows(void);
+
+/** \brief Number of channels refused because the channel pool was full */
+uint32_t node_table_channel_overflows(void);
+
+#endif /* NODE_TABLE_H_ */
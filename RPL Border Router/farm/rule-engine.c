@@ -0,0 +1,275 @@
+/**
+ * \file
+ *      Table-driven control rules for the border router.
+ */
+
+#include "rule-engine.h"
+#include "actuator-push.h"
+#include "node-table.h"
+#include "sys/ctimer.h"
+
+#include <string.h>
+
+#if RULE_ENGINE_MAX_INPUTS > NODE_TABLE_INDEXED_TYPES
+#error "The node table must index every channel a rule may read"
+#endif
+
+#include "sys/log.h"
+#define LOG_MODULE "Rules"
+#define LOG_LEVEL LOG_LEVEL_INFO
+
+typedef struct rule_state {
+  struct ctimer hold_timer;   /* Runs while a min on/off time defers a change */
+  clock_time_t changed_at;
+  clock_time_t sensed_at;     /* Sample behind the deferred change */
+  int32_t value;              /* Last input value seen */
+  uint8_t on;
+  uint8_t decided;
+} rule_state_t;
+
+static const farm_rule_t *rules;
+static uint8_t rule_count;
+static rule_state_t state[RULE_ENGINE_MAX_RULES];
+
+/* Rules reading each channel, one bit per rule */
+static uint32_t dependents[RULE_ENGINE_MAX_INPUTS];
+
+static uint8_t outputs[RULE_ENGINE_MAX_CLASSES];
+
+/* Runs until the first sample a rule still counts gets too old */
+static struct ctimer age_timer;
+static clock_time_t age_at;
+
+static void evaluate(uint8_t i, clock_time_t sensed_at);
+/*---------------------------------------------------------------------------*/
+static int
+wanted(const farm_rule_t *r, int32_t value, int on)
+{
+  if(r->mode == RULE_ON_BELOW) {
+    if(value < r->on_level) {
+      return 1;
+    }
+    if(value > r->off_level) {
+      return 0;
+    }
+  } else {
+    if(value > r->on_level) {
+      return 1;
+    }
+    if(value < r->off_level) {
+      return 0;
+    }
+  }
+  /* Inside the hysteresis band */
+  return on;
+}
+/*---------------------------------------------------------------------------*/
+/* Every recent sample of a channel combined, 0 if there is none. The
+   oldest of them is returned, it decides when the value changes next. */
+static int
+combined(uint8_t input, uint8_t combine, int32_t *value,
+         clock_time_t *oldest)
+{
+  const node_channel_t *ch;
+  clock_time_t now = clock_time();
+  int64_t sum = 0;
+  int32_t v = 0;
+  uint16_t n = 0;
+
+  for(ch = node_table_first_of(input); ch != NULL; ch = ch->type_next) {
+    if(now - ch->updated > RULE_ENGINE_MAX_AGE) {
+      continue;
+    }
+    if(n == 0 ||
+       (combine == RULE_INPUT_MIN && ch->value < v) ||
+       (combine == RULE_INPUT_MAX && ch->value > v)) {
+      v = ch->value;
+    }
+    if(n == 0 || now - ch->updated > now - *oldest) {
+      *oldest = ch->updated;
+    }
+    sum += ch->value;
+    n++;
+  }
+
+  if(n == 0) {
+    return 0;
+  }
+  *value = combine == RULE_INPUT_MEAN ? (int32_t)(sum / n) : v;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hold_expired(void *ptr)
+{
+  rule_state_t *s = ptr;
+
+  evaluate(s - state, s->sensed_at);
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_output(const farm_rule_t *r, int on, clock_time_t sensed_at)
+{
+  uint8_t bits = outputs[r->node_class];
+
+  if(on) {
+    bits |= r->output;
+  } else {
+    bits &= ~r->output;
+  }
+  outputs[r->node_class] = bits;
+
+  actuator_push_set(r->node_class, bits, sensed_at);
+}
+/*---------------------------------------------------------------------------*/
+static void
+evaluate(uint8_t i, clock_time_t sensed_at)
+{
+  const farm_rule_t *r = &rules[i];
+  rule_state_t *s = &state[i];
+  clock_time_t hold;
+  clock_time_t elapsed;
+  int on;
+
+  on = wanted(r, s->value, s->on);
+  if(s->decided && on == s->on) {
+    ctimer_stop(&s->hold_timer);
+    return;
+  }
+
+  /* The first decision is never held back */
+  if(s->decided) {
+    hold = s->on ? r->min_on : r->min_off;
+    elapsed = clock_time() - s->changed_at;
+    if(elapsed < hold) {
+      s->sensed_at = sensed_at;
+      ctimer_set(&s->hold_timer, hold - elapsed, hold_expired, s);
+      return;
+    }
+  }
+
+  s->on = on;
+  s->decided = 1;
+  s->changed_at = clock_time();
+  LOG_INFO("Rule %u: class %u bit 0x%02x %s\n", i, r->node_class,
+           r->output, on ? "ON" : "OFF");
+  set_output(r, on, sensed_at);
+}
+/*---------------------------------------------------------------------------*/
+/* No input left to decide on, switch the output off until one returns */
+static void
+stale(uint8_t i)
+{
+  const farm_rule_t *r = &rules[i];
+  rule_state_t *s = &state[i];
+
+  if(!s->decided) {
+    return;
+  }
+  ctimer_stop(&s->hold_timer);
+  s->decided = 0;
+  if(s->on) {
+    s->on = 0;
+    s->changed_at = clock_time();
+    LOG_WARN("Rule %u: no input for %lu s, class %u bit 0x%02x OFF\n", i,
+             (unsigned long)(RULE_ENGINE_MAX_AGE / CLOCK_SECOND),
+             r->node_class, r->output);
+    set_output(r, 0, clock_time());
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void aged(void *ptr);
+
+/* Combine the input of rule i again and evaluate it if that changed */
+static void
+refresh(uint8_t i, clock_time_t sensed_at)
+{
+  clock_time_t oldest;
+  clock_time_t at;
+  int32_t value;
+
+  if(!combined(rules[i].input, rules[i].combine, &value, &oldest)) {
+    stale(i);
+    return;
+  }
+
+  /* The value changes once the oldest sample drops out */
+  at = oldest + RULE_ENGINE_MAX_AGE + 1;
+  if(ctimer_expired(&age_timer) || age_at - clock_time() > at - clock_time()) {
+    age_at = at;
+    ctimer_set(&age_timer, at - clock_time(), aged, NULL);
+  }
+
+  /* An unchanged value cannot change the decision */
+  if(state[i].decided && state[i].value == value) {
+    return;
+  }
+  state[i].value = value;
+  evaluate(i, sensed_at);
+}
+/*---------------------------------------------------------------------------*/
+static void
+aged(void *ptr)
+{
+  uint8_t i;
+
+  for(i = 0; i < rule_count; i++) {
+    refresh(i, clock_time());
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+rule_engine_init(const farm_rule_t *table, uint8_t count)
+{
+  uint8_t i;
+
+  if(count > RULE_ENGINE_MAX_RULES || count > 32) {
+    return 0;
+  }
+  for(i = 0; i < count; i++) {
+    if(table[i].input >= RULE_ENGINE_MAX_INPUTS
+       || table[i].combine > RULE_INPUT_MEAN
+       || table[i].node_class >= RULE_ENGINE_MAX_CLASSES) {
+      return 0;
+    }
+  }
+
+  rules = table;
+  rule_count = count;
+  memset(state, 0, sizeof(state));
+  memset(dependents, 0, sizeof(dependents));
+  memset(outputs, 0, sizeof(outputs));
+  ctimer_stop(&age_timer);
+
+  for(i = 0; i < count; i++) {
+    dependents[table[i].input] |= (uint32_t)1 << i;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+rule_engine_input(uint8_t input, clock_time_t sensed_at)
+{
+  uint32_t deps;
+  uint8_t i;
+
+  if(input >= RULE_ENGINE_MAX_INPUTS) {
+    return;
+  }
+
+  for(deps = dependents[input], i = 0; deps != 0; deps >>= 1, i++) {
+    if(deps & 1) {
+      refresh(i, sensed_at);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int32_t
+rule_engine_output(uint8_t node_class)
+{
+  if(node_class >= RULE_ENGINE_MAX_CLASSES) {
+    return 0;
+  }
+  return outputs[node_class];
+}
+/*---------------------------------------------------------------------------*/
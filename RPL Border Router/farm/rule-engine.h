@@ -0,0 +1,81 @@
+/**
+ * \file
+ *      Table-driven control rules for the border router.
+ *
+ *      Each rule switches one actuator bit from one sensor channel, with
+ *      a hysteresis band and minimum on/off times. The channel is read
+ *      from the node table and combined over every node and probe that
+ *      reported it within RULE_ENGINE_MAX_AGE, as the minimum, maximum or
+ *      mean the rule asks for. Two grow beds or several probes therefore
+ *      feed one explicit value instead of overwriting each other.
+ *
+ *      A rule is evaluated only when a new sample changes that value, so
+ *      rules on other channels cost nothing per sample. The node table
+ *      chains the channels by type, so combining visits only the nodes
+ *      that report the channel, not every node and channel in the table.
+ *
+ *      When the last sample a rule counts gets older than
+ *      RULE_ENGINE_MAX_AGE, its output is switched off: a pump or light
+ *      whose sensors went silent does not keep running on the last value.
+ */
+
+#ifndef RULE_ENGINE_H_
+#define RULE_ENGINE_H_
+
+#include "contiki.h"
+
+#ifdef RULE_ENGINE_CONF_MAX_RULES
+#define RULE_ENGINE_MAX_RULES     RULE_ENGINE_CONF_MAX_RULES
+#else
+#define RULE_ENGINE_MAX_RULES     16
+#endif
+
+/* Channel types (FARM_TLV_*) a rule may read, must be below this */
+#define RULE_ENGINE_MAX_INPUTS    16
+/* Actuator classes (FARM_NODE_*) a rule may drive, must be below this */
+#define RULE_ENGINE_MAX_CLASSES   8
+
+/* Samples older than this are left out of the combined value */
+#ifdef RULE_ENGINE_CONF_MAX_AGE
+#define RULE_ENGINE_MAX_AGE       RULE_ENGINE_CONF_MAX_AGE
+#else
+#define RULE_ENGINE_MAX_AGE       (60 * 60 * CLOCK_SECOND)
+#endif
+
+/* How the samples of all nodes and probes are combined */
+#define RULE_INPUT_MIN            0
+#define RULE_INPUT_MAX            1
+#define RULE_INPUT_MEAN           2
+
+/* When the output bit is switched on */
+#define RULE_ON_BELOW             0   /* on below on_level, off above off_level */
+#define RULE_ON_ABOVE             1   /* on above on_level, off below off_level */
+
+typedef struct farm_rule {
+  uint8_t input;              /* FARM_TLV_* channel */
+  uint8_t combine;            /* RULE_INPUT_* over the nodes and probes */
+  uint8_t mode;               /* RULE_ON_BELOW or RULE_ON_ABOVE */
+  int32_t on_level;
+  int32_t off_level;          /* Values between the levels keep the output */
+  uint8_t node_class;         /* FARM_NODE_* actuator to drive */
+  uint8_t output;             /* FARM_ACTUATOR_* bit */
+  clock_time_t min_on;        /* Shortest time the output stays on */
+  clock_time_t min_off;       /* Shortest time the output stays off */
+} farm_rule_t;
+
+/**
+ * \brief Load a rule table, which must outlive the engine
+ * \return 1 on success, 0 if the table does not fit the limits above
+ */
+int rule_engine_init(const farm_rule_t *rules, uint8_t count);
+
+/**
+ * \brief A channel got a new sample, already stored in the node table
+ * \param sensed_at When the sample was taken
+ */
+void rule_engine_input(uint8_t input, clock_time_t sensed_at);
+
+/** \brief Current FARM_ACTUATOR_* bits decided for an actuator class */
+int32_t rule_engine_output(uint8_t node_class);
+
+#endif /* RULE_ENGINE_H_ */
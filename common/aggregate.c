@@ -0,0 +1,58 @@
+/**
+ * \file
+ *      Streaming min/max/mean/count/last of a sensor channel over a
+ *      report window, in constant memory.
+ */
+
+#include "aggregate.h"
+
+/*---------------------------------------------------------------------------*/
+void
+aggregate_reset(aggregate_t *a)
+{
+  a->sum = 0;
+  a->min = INT32_MAX;
+  a->max = INT32_MIN;
+  a->last = 0;
+  a->count = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+aggregate_add(aggregate_t *a, int32_t value)
+{
+  if(value < a->min) {
+    a->min = value;
+  }
+  if(value > a->max) {
+    a->max = value;
+  }
+  a->sum += value;
+  a->last = value;
+  a->count++;
+}
+/*---------------------------------------------------------------------------*/
+int32_t
+aggregate_mean(const aggregate_t *a)
+{
+  if(a->count == 0) {
+    return 0;
+  }
+  /* Round half away from zero */
+  if(a->sum < 0) {
+    return (int32_t)((a->sum - (int64_t)(a->count / 2)) / (int64_t)a->count);
+  }
+  return (int32_t)((a->sum + (int64_t)(a->count / 2)) / (int64_t)a->count);
+}
+/*---------------------------------------------------------------------------*/
+int
+aggregate_put(farm_frame_writer_t *w, uint8_t type, const aggregate_t *a)
+{
+  if(a->count == 0) {
+    return 0;
+  }
+  return farm_frame_put_int(w, type, a->last)
+         && farm_frame_put_int(w, FARM_TLV_MIN(type), a->min)
+         && farm_frame_put_int(w, FARM_TLV_MAX(type), a->max)
+         && farm_frame_put_int(w, FARM_TLV_MEAN(type), aggregate_mean(a));
+}
+/*---------------------------------------------------------------------------*/
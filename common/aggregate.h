@@ -0,0 +1,38 @@
+/**
+ * \file
+ *      Streaming min/max/mean/count/last of a sensor channel over a
+ *      report window, in constant memory.
+ */
+
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include "farm-frame.h"
+
+typedef struct aggregate {
+  int64_t sum;
+  int32_t min;
+  int32_t max;
+  int32_t last;
+  uint32_t count;
+} aggregate_t;
+
+/** \brief Start a new window */
+void aggregate_reset(aggregate_t *a);
+
+void aggregate_add(aggregate_t *a, int32_t value);
+
+/** \brief Mean of the window rounded to the nearest integer, 0 if empty */
+int32_t aggregate_mean(const aggregate_t *a);
+
+/**
+ * \brief Append the window of one channel to a frame
+ * \param type FARM_TLV_* of the channel, carries the last sample
+ * \return 1 on success, 0 if the window is empty or the frame is full
+ *
+ * The last sample goes first under the plain type, so a receiver that
+ * does not know the statistics records still gets the current value.
+ */
+int aggregate_put(farm_frame_writer_t *w, uint8_t type, const aggregate_t *a);
+
+#endif /* AGGREGATE_H_ */
@@ -0,0 +1,226 @@
+/**
+ * \file
+ *      Asynchronous command transactions with Atlas Scientific EZO
+ *      circuits over I2C.
+ */
+
+#include "ezo.h"
+#include "dev/i2c-arch.h"
+#include "lib/list.h"
+#include "trace.h"
+#include <Board.h>
+
+#include <string.h>
+
+#include "sys/log.h"
+#define LOG_MODULE "EZO"
+#ifdef LOG_CONF_LEVEL_FARM
+#define LOG_LEVEL LOG_CONF_LEVEL_FARM
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+process_event_t ezo_event;
+
+#define FIXED_MAX                 0x7fffffffUL
+
+LIST(pending);
+static struct ctimer bus_timer;
+
+/*---------------------------------------------------------------------------*/
+static void
+finish(ezo_request_t *req, uint8_t status)
+{
+  list_remove(pending, req);
+  req->status = status;
+  if(status != EZO_STATUS_OK) {
+    LOG_WARN("0x%02x: status %u after %u polls\n",
+             req->addr, status, req->polls);
+    TRACE(TRACE_EZO_STATUS, req->addr, status);
+  }
+  process_post(req->owner, ezo_event, req);
+}
+/*---------------------------------------------------------------------------*/
+static void bus_poll(void *ptr);
+
+static void
+schedule(void)
+{
+  ezo_request_t *req;
+  clock_time_t now = clock_time();
+  clock_time_t wait = EZO_TIMEOUT;
+
+  for(req = list_head(pending); req != NULL; req = list_item_next(req)) {
+    if(!CLOCK_LT(now, req->due)) {
+      wait = 0;
+    } else {
+      wait = MIN(wait, req->due - now);
+    }
+  }
+
+  if(list_head(pending) != NULL) {
+    ctimer_set(&bus_timer, wait, bus_poll, NULL);
+  } else {
+    ctimer_stop(&bus_timer);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+poll(I2C_Handle handle, ezo_request_t *req)
+{
+  /*
+   * The status byte comes first in the reply, so every poll reads the
+   * whole reply in one transaction and a ready reply needs no second read.
+   */
+  memset(req->reply, 0, sizeof(req->reply));
+  req->polls++;
+  if(!i2c_arch_read(handle, req->addr, req->reply, sizeof(req->reply))) {
+    finish(req, EZO_STATUS_BUS_ERROR);
+    return;
+  }
+
+  if(req->reply[0] == EZO_STATUS_PENDING) {
+    if(clock_time() - req->started >= EZO_TIMEOUT) {
+      finish(req, EZO_STATUS_TIMEOUT);
+      return;
+    }
+    req->due = clock_time() + req->backoff;
+    req->backoff = MIN(req->backoff * 2, EZO_POLL_MAX);
+    return;
+  }
+
+  /* Terminate data that filled the whole buffer */
+  req->reply[EZO_REPLY_LEN - 1] = '\0';
+  finish(req, req->reply[0]);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bus_poll(void *ptr)
+{
+  ezo_request_t *req;
+  ezo_request_t *next;
+  I2C_Handle handle;
+  clock_time_t now = clock_time();
+
+  /*
+   * Every circuit that is due, or nearly so, is read in this wake-up
+   * under a single acquisition of the bus.
+   */
+  handle = i2c_arch_acquire(Board_I2C0);
+  for(req = list_head(pending); req != NULL; req = next) {
+    next = list_item_next(req);
+    if(!CLOCK_LT(now + EZO_POLL_MIN, req->due)) {
+      poll(handle, req);
+    }
+  }
+  i2c_arch_release(handle);
+
+  schedule();
+}
+/*---------------------------------------------------------------------------*/
+void
+ezo_init(void)
+{
+  if(ezo_event == 0) {
+    ezo_event = process_alloc_event();
+    list_init(pending);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+ezo_request(ezo_request_t *req, uint8_t addr, const char *cmd,
+            clock_time_t first_poll)
+{
+  I2C_Handle handle;
+  bool ok;
+
+  list_remove(pending, req);
+  req->owner = PROCESS_CURRENT();
+  req->addr = addr;
+  req->status = EZO_STATUS_PENDING;
+  req->polls = 0;
+  req->backoff = EZO_POLL_MIN;
+
+  /* Commands go out without their terminator */
+  handle = i2c_arch_acquire(Board_I2C0);
+  ok = i2c_arch_write(handle, addr, (void *)cmd, strlen(cmd));
+  i2c_arch_release(handle);
+  if(!ok) {
+    req->status = EZO_STATUS_BUS_ERROR;
+    return 0;
+  }
+
+  req->started = clock_time();
+  req->due = req->started + first_poll;
+  list_add(pending, req);
+  schedule();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+ezo_fixed(const ezo_request_t *req, uint8_t decimals, int32_t *value)
+{
+  const uint8_t *p = &req->reply[1];
+  const uint8_t *end = &req->reply[EZO_REPLY_LEN];
+  uint32_t v = 0;
+  int negative = 0;
+  int digits = 0;
+  int point = 0;
+  int kept = 0;
+  int round_up = 0;
+
+  if(req->status != EZO_STATUS_OK) {
+    return 0;
+  }
+
+  if(p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+
+  for(; p < end && *p != '\0' && *p != ','; p++) {
+    if(*p == '.' && !point) {
+      point = 1;
+    } else if(*p >= '0' && *p <= '9') {
+      digits++;
+      if(point && kept >= decimals) {
+        /* Only the first dropped digit matters for rounding */
+        if(kept++ == decimals) {
+          round_up = (*p >= '5');
+        }
+        continue;
+      }
+      if(v > (FIXED_MAX - (*p - '0')) / 10) {
+        return 0;
+      }
+      v = v * 10 + (*p - '0');
+      if(point) {
+        kept++;
+      }
+    } else {
+      return 0;
+    }
+  }
+
+  if(digits == 0) {
+    return 0;
+  }
+
+  /* Pad missing decimals, then round */
+  for(; kept < decimals; kept++) {
+    if(v > FIXED_MAX / 10) {
+      return 0;
+    }
+    v *= 10;
+  }
+  if(round_up) {
+    if(v == FIXED_MAX) {
+      return 0;
+    }
+    v++;
+  }
+
+  *value = negative ? -(int32_t)v : (int32_t)v;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,113 @@
+/**
+ * \file
+ *      Asynchronous command transactions with Atlas Scientific EZO
+ *      circuits over I2C.
+ *
+ *      A command is written, then the reply is polled with a growing
+ *      back-off until the circuit stops answering "still processing".
+ *      The owner process gets ezo_event with the request as data as soon
+ *      as the reply is in, instead of sleeping for the worst-case
+ *      processing time from the datasheet. Only a reply with the success
+ *      status is handed over as data.
+ *
+ *      Several circuits can share the bus. Their transactions are
+ *      serialized by one bus timer, and polls falling due within
+ *      EZO_POLL_MIN of each other are done in the same wake-up, so
+ *      commands started together with the same first poll are collected
+ *      together.
+ */
+
+#ifndef EZO_H_
+#define EZO_H_
+
+#include "contiki.h"
+
+/* Reply size: status byte, ASCII data and its NUL terminator */
+#ifdef EZO_CONF_REPLY_LEN
+#define EZO_REPLY_LEN             EZO_CONF_REPLY_LEN
+#else
+#define EZO_REPLY_LEN             32
+#endif
+
+/* First and longest gap between two polls, the gap doubles in between */
+#ifdef EZO_CONF_POLL_MIN
+#define EZO_POLL_MIN              EZO_CONF_POLL_MIN
+#else
+#define EZO_POLL_MIN              (CLOCK_SECOND / 50)
+#endif
+
+#ifdef EZO_CONF_POLL_MAX
+#define EZO_POLL_MAX              EZO_CONF_POLL_MAX
+#else
+#define EZO_POLL_MAX              (CLOCK_SECOND / 8)
+#endif
+
+/* Give up on a command that is still processing after this long */
+#ifdef EZO_CONF_TIMEOUT
+#define EZO_TIMEOUT               EZO_CONF_TIMEOUT
+#else
+#define EZO_TIMEOUT               (2 * CLOCK_SECOND)
+#endif
+
+/* Status byte of a reply */
+#define EZO_STATUS_OK             1
+#define EZO_STATUS_ERROR          2     /* Syntax error */
+#define EZO_STATUS_PENDING        254   /* Still processing */
+#define EZO_STATUS_NO_DATA        255
+
+/* Never sent by the circuit */
+#define EZO_STATUS_BUS_ERROR      0     /* I2C transfer failed */
+#define EZO_STATUS_TIMEOUT        3
+
+typedef struct ezo_request {
+  struct ezo_request *next;   /* Pending list */
+  struct process *owner;
+  clock_time_t started;
+  clock_time_t due;           /* Next poll */
+  clock_time_t backoff;
+  uint8_t addr;
+  uint8_t status;             /* EZO_STATUS_* once ezo_event is posted */
+  uint8_t polls;
+  uint8_t reply[EZO_REPLY_LEN];
+} ezo_request_t;
+
+/** \brief Posted to the owner process when a request completes */
+extern process_event_t ezo_event;
+
+void ezo_init(void);
+
+/**
+ * \brief Send a command and start polling for its reply
+ * \param req Request, must stay allocated until ezo_event
+ * \param addr I2C address of the circuit
+ * \param cmd ASCII command, for instance "r"
+ * \param first_poll Time before the first poll, the shortest time in
+ *        which the circuit can possibly answer
+ * \return 1 if the command was written and ezo_event will follow, 0 if
+ *         the I2C write failed
+ */
+int ezo_request(ezo_request_t *req, uint8_t addr, const char *cmd,
+                clock_time_t first_poll);
+
+/**
+ * \brief Parse the first field of a successful reply as a fixed-point
+ *        number
+ * \param decimals Decimal digits to keep, value is the reading times 10^decimals
+ * \return 1 on success, 0 if the field is not a decimal number or does
+ *         not fit in 32 bits
+ *
+ * Handles an optional sign and any number of digits on either side of
+ * the point within the reply buffer. Extra decimals are rounded half
+ * away from zero. A field ends at the terminator or at the comma that
+ * separates the readings of a multi-parameter reply.
+ */
+int ezo_fixed(const ezo_request_t *req, uint8_t decimals, int32_t *value);
+
+/** \brief ASCII data of a successful reply, NUL terminated */
+static inline const char *
+ezo_data(const ezo_request_t *req)
+{
+  return (const char *)&req->reply[1];
+}
+
+#endif /* EZO_H_ */
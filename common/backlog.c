@@ -0,0 +1,393 @@
+/**
+ * \file
+ *      Store-and-forward backlog for telemetry frames.
+ */
+
+#include "backlog.h"
+#include "node-config.h"
+#include "net/routing/routing.h"
+#include "random.h"
+#include "trace.h"
+#if BACKLOG_WITH_CFS
+#include "cfs/cfs.h"
+#endif
+
+#include <string.h>
+
+#include "sys/log.h"
+#define LOG_MODULE "Backlog"
+#ifdef LOG_CONF_LEVEL_FARM
+#define LOG_LEVEL LOG_CONF_LEVEL_FARM
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+typedef struct backlog_entry {
+  unsigned long stored;       /* clock_seconds() when the frame was held */
+  uint8_t len;
+  uint8_t frame[FARM_FRAME_MAX_LEN];
+} backlog_entry_t;
+
+/* Entry flags, kept in RAM even when the frames are in CFS */
+#define ENTRY_SENT                0x01
+#define ENTRY_ACKED               0x02
+
+#if BACKLOG_WITH_CFS
+#define BACKLOG_FILE              "backlog"
+static int fd = -1;
+#else
+static backlog_entry_t ring[BACKLOG_SIZE];
+#endif
+
+static uint16_t seqs[BACKLOG_SIZE];
+static uint8_t flags[BACKLOG_SIZE];
+
+static struct simple_udp_connection *udp_conn;
+static uint16_t head;         /* Oldest frame */
+static uint16_t count;
+static uint16_t unsent;
+static uint16_t next_seq;
+static uint32_t dropped;
+static uint32_t retransmitted;
+
+PROCESS(backlog_process, "Backlog drain");
+/*---------------------------------------------------------------------------*/
+#if BACKLOG_WITH_CFS
+static int
+load(uint16_t slot, backlog_entry_t *e)
+{
+  return cfs_seek(fd, slot * sizeof(*e), CFS_SEEK_SET) >= 0
+    && cfs_read(fd, e, sizeof(*e)) == sizeof(*e);
+}
+/*---------------------------------------------------------------------------*/
+static int
+store(uint16_t slot, const backlog_entry_t *e)
+{
+  return cfs_seek(fd, slot * sizeof(*e), CFS_SEEK_SET) >= 0
+    && cfs_write(fd, e, sizeof(*e)) == sizeof(*e);
+}
+#else
+/*---------------------------------------------------------------------------*/
+static int
+load(uint16_t slot, backlog_entry_t *e)
+{
+  memcpy(e, &ring[slot], sizeof(*e));
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+store(uint16_t slot, const backlog_entry_t *e)
+{
+  memcpy(&ring[slot], e, sizeof(*e));
+  return 1;
+}
+#endif /* BACKLOG_WITH_CFS */
+/*---------------------------------------------------------------------------*/
+static uint16_t
+slot_of(uint16_t i)
+{
+  return (head + i) % BACKLOG_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+/* Without acks a frame is done once sent, with acks once acknowledged */
+static int
+released(uint16_t slot)
+{
+  return (flags[slot] & ENTRY_ACKED)
+    || (!FARM_TELEMETRY_ACK && (flags[slot] & ENTRY_SENT));
+}
+/*---------------------------------------------------------------------------*/
+static void
+release_head(void)
+{
+  while(count > 0 && released(head)) {
+    head = (head + 1) % BACKLOG_SIZE;
+    count--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+seq_of(const uint8_t *frame, uint16_t len)
+{
+  farm_frame_reader_t r;
+  farm_tlv_t tlv;
+  int32_t value;
+
+  if(farm_frame_open(&r, frame, len)) {
+    while(farm_frame_next(&r, &tlv)) {
+      if(tlv.type == FARM_TLV_SEQ && farm_tlv_int(&tlv, &value)) {
+        return (uint16_t)value;
+      }
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+hold(const uint8_t *frame, uint16_t len, uint8_t entry_flags)
+{
+  static backlog_entry_t e;
+  uint16_t slot;
+
+  if(len < FARM_FRAME_HDR_LEN || len > FARM_FRAME_MAX_LEN) {
+    return 0;
+  }
+
+  if(count == BACKLOG_SIZE) {
+    /* Oldest first, the newest readings are worth the most */
+    if(!(flags[head] & ENTRY_SENT)) {
+      unsent--;
+    }
+    head = (head + 1) % BACKLOG_SIZE;
+    count--;
+    dropped++;
+  }
+
+  e.stored = clock_seconds();
+  e.len = (uint8_t)len;
+  memcpy(e.frame, frame, len);
+  slot = slot_of(count);
+  if(!store(slot, &e)) {
+    return 0;
+  }
+  seqs[slot] = seq_of(frame, len);
+  flags[slot] = entry_flags;
+  count++;
+  if(!(entry_flags & ENTRY_SENT)) {
+    unsent++;
+    TRACE(TRACE_HELD, seqs[slot], count);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+backlog_init(struct simple_udp_connection *conn)
+{
+  udp_conn = conn;
+  head = 0;
+  count = 0;
+  unsent = 0;
+  next_seq = 0;
+  dropped = 0;
+  retransmitted = 0;
+
+#if BACKLOG_WITH_CFS
+  /* Ages are taken from the uptime, frames of an earlier boot are lost */
+  cfs_remove(BACKLOG_FILE);
+  fd = cfs_open(BACKLOG_FILE, CFS_READ | CFS_WRITE);
+  if(fd < 0) {
+    LOG_ERR("Cannot open %s\n", BACKLOG_FILE);
+  }
+#endif
+
+  process_start(&backlog_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+backlog_next_seq(void)
+{
+  uint16_t seq = next_seq++;
+
+  /* 0 tells the border router the node restarted, skip it on wrap */
+  if(next_seq == 0) {
+    next_seq = 1;
+  }
+  return seq;
+}
+/*---------------------------------------------------------------------------*/
+int
+backlog_put_seq(farm_frame_writer_t *w)
+{
+  /* The boot count goes first, the border router needs it for the seq */
+  return farm_frame_put_int(w, FARM_TLV_BOOT, node_config_boot())
+    && farm_frame_put_seq(w, FARM_TLV_SEQ, backlog_next_seq());
+}
+/*---------------------------------------------------------------------------*/
+int
+backlog_put(const uint8_t *frame, uint16_t len)
+{
+  return hold(frame, len, 0);
+}
+/*---------------------------------------------------------------------------*/
+int
+backlog_send(const uint8_t *frame, uint16_t len, const uip_ipaddr_t *dest)
+{
+  /* Keep the order: a frame never overtakes older ones still held */
+  if(unsent > 0) {
+    hold(frame, len, 0);
+    process_poll(&backlog_process);
+    return 0;
+  }
+
+  simple_udp_sendto(udp_conn, frame, len, dest);
+  TRACE(TRACE_REPORT, seq_of(frame, len), len);
+  if(FARM_TELEMETRY_ACK) {
+    /* Kept for a retransmission until the border router confirms it */
+    hold(frame, len, ENTRY_SENT);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+backlog_input(const uint8_t *data, uint16_t len)
+{
+  farm_frame_reader_t r;
+  farm_tlv_t tlv;
+  int32_t value;
+  uint32_t received = 0;
+  uint16_t ack = 0;
+  uint16_t newest;
+  uint16_t i;
+  uint16_t slot;
+  int16_t d;
+
+  if(!farm_frame_open(&r, data, len) || r.msg_type != FARM_MSG_TELEMETRY_ACK) {
+    return 0;
+  }
+  while(farm_frame_next(&r, &tlv)) {
+    if(!farm_tlv_int(&tlv, &value)) {
+      continue;
+    }
+    if(tlv.type == FARM_TLV_SEQ) {
+      ack = (uint16_t)value;
+    } else if(tlv.type == FARM_TLV_SEQ_RECEIVED) {
+      received = (uint32_t)value;
+    }
+  }
+
+  /* Newest frame the border router has */
+  newest = ack;
+  for(i = 32; i > 0; i--) {
+    if(received & (1UL << (i - 1))) {
+      newest = ack + i;
+      break;
+    }
+  }
+
+  for(i = 0; i < count; i++) {
+    slot = slot_of(i);
+    if(!(flags[slot] & ENTRY_SENT)) {
+      continue;
+    }
+    d = farm_seq_diff(seqs[slot], ack);
+    if(d <= 0 || (d <= 32 && (received & (1UL << (d - 1))))) {
+      flags[slot] |= ENTRY_ACKED;
+    } else if(farm_seq_diff(seqs[slot], newest) < 0) {
+      /* Newer frames made it, this one was lost on the way */
+      flags[slot] &= ~ENTRY_SENT;
+      unsent++;
+      retransmitted++;
+    }
+  }
+
+  release_head();
+  if(unsent > 0) {
+    process_poll(&backlog_process);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Move as many unsent frames as fit into one batch datagram. The nested
+ * frame keeps its header, gets the age record and then its own records.
+ */
+static uint16_t
+build_batch(uint8_t *buf, uint16_t size)
+{
+  static backlog_entry_t e;
+  farm_frame_writer_t w;
+  farm_frame_writer_t nested;
+  uint16_t start;
+  uint16_t i;
+  uint16_t slot;
+
+  w.len = 0;
+  for(i = 0; i < count; i++) {
+    slot = slot_of(i);
+    if((flags[slot] & ENTRY_SENT) || !load(slot, &e)) {
+      continue;
+    }
+
+    if(w.len == 0) {
+      farm_frame_begin(&w, buf, size, FARM_MSG_BATCH, e.frame[2]);
+    }
+    if(w.len + BACKLOG_ENTRY_OVERHEAD + e.len > size) {
+      break;
+    }
+
+    start = w.len + FARM_FRAME_TLV_HDR_LEN;
+    nested.buf = &buf[start];
+    nested.size = size - start;
+    nested.len = FARM_FRAME_HDR_LEN;
+    memcpy(nested.buf, e.frame, FARM_FRAME_HDR_LEN);
+    farm_frame_put_int(&nested, FARM_TLV_AGE,
+                       (int32_t)(clock_seconds() - e.stored));
+    memcpy(&nested.buf[nested.len], &e.frame[FARM_FRAME_HDR_LEN],
+           e.len - FARM_FRAME_HDR_LEN);
+    nested.len += e.len - FARM_FRAME_HDR_LEN;
+
+    buf[w.len] = FARM_TLV_FRAME;
+    buf[w.len + 1] = (uint8_t)nested.len;
+    w.len += FARM_FRAME_TLV_HDR_LEN + nested.len;
+
+    flags[slot] |= ENTRY_SENT;
+    unsent--;
+  }
+
+  release_head();
+  return w.len;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+backlog_count(void)
+{
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+backlog_dropped(void)
+{
+  return dropped;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+backlog_retransmitted(void)
+{
+  return retransmitted;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(backlog_process, ev, data)
+{
+  static struct etimer pace;
+  static uint8_t batch[BACKLOG_BATCH_LEN];
+  uip_ipaddr_t dest_ipaddr;
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+    while(unsent > 0) {
+      /* Lost the route again, wait for the next report to poll us */
+      if(!NETSTACK_ROUTING.node_is_reachable() ||
+         !NETSTACK_ROUTING.get_root_ipaddr(&dest_ipaddr)) {
+        break;
+      }
+
+      len = build_batch(batch, sizeof(batch));
+      if(len == 0) {
+        break;
+      }
+      simple_udp_sendto(udp_conn, batch, len, &dest_ipaddr);
+      LOG_INFO("Sent batch of %u bytes, %u frames left\n", len, unsent);
+      TRACE(TRACE_BATCH, unsent, len);
+
+      etimer_set(&pace, BACKLOG_PACE + random_rand() % (BACKLOG_PACE / 2 + 1));
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&pace));
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,116 @@
+/**
+ * \file
+ *      Store-and-forward backlog for telemetry frames built while the
+ *      node has no route to the border router.
+ *
+ *      Frames are kept in a fixed ring with the time they were built.
+ *      When the ring is full the oldest frame is dropped. Once the node is
+ *      back on the DODAG, the next report queues behind the held frames
+ *      and they are sent oldest first, packed into FARM_MSG_BATCH
+ *      datagrams, one datagram every BACKLOG_PACE plus some jitter so
+ *      that a whole network coming back after a border router restart
+ *      does not drain at once.
+ *
+ *      Each held frame is sent as a FARM_TLV_FRAME record whose nested
+ *      frame starts with a FARM_TLV_AGE record.
+ *
+ *      Every telemetry frame starts with the FARM_TLV_BOOT and FARM_TLV_SEQ
+ *      records of backlog_put_seq(). With FARM_TELEMETRY_ACK the frames sent stay in
+ *      the ring until the border router acknowledges them, and the ones
+ *      the ack shows as lost are sent again.
+ *
+ *      With BACKLOG_CONF_WITH_CFS the ring lives in a CFS file instead of
+ *      RAM, which allows a much larger BACKLOG_SIZE. The ring is cleared
+ *      at boot as the frame ages would not survive a reboot. This needs
+ *      MODULES += $(CONTIKI_NG_STORAGE_DIR)/cfs in the Makefile.
+ */
+
+#ifndef BACKLOG_H_
+#define BACKLOG_H_
+
+#include "contiki.h"
+#include "net/ipv6/simple-udp.h"
+#include "farm-frame.h"
+
+#ifdef BACKLOG_CONF_WITH_CFS
+#define BACKLOG_WITH_CFS          BACKLOG_CONF_WITH_CFS
+#else
+#define BACKLOG_WITH_CFS          0
+#endif
+
+/* Frames held, 8 in RAM is 4 hours of heartbeats */
+#ifdef BACKLOG_CONF_SIZE
+#define BACKLOG_SIZE              BACKLOG_CONF_SIZE
+#elif BACKLOG_WITH_CFS
+#define BACKLOG_SIZE              64
+#else
+#define BACKLOG_SIZE              8
+#endif
+
+/* Time between two batch datagrams, a random share of it is added */
+#ifdef BACKLOG_CONF_PACE
+#define BACKLOG_PACE              BACKLOG_CONF_PACE
+#else
+#define BACKLOG_PACE              (2 * CLOCK_SECOND)
+#endif
+
+/* Largest batch datagram, one link-layer frame without security */
+#ifdef BACKLOG_CONF_BATCH_LEN
+#define BACKLOG_BATCH_LEN         BACKLOG_CONF_BATCH_LEN
+#else
+#define BACKLOG_BATCH_LEN         96
+#endif
+
+/* Room for a single held frame with its age record in a batch */
+#define BACKLOG_ENTRY_OVERHEAD    (FARM_FRAME_TLV_HDR_LEN * 2 + 4)
+
+#if BACKLOG_BATCH_LEN < FARM_FRAME_HDR_LEN + FARM_FRAME_MAX_LEN + \
+                        BACKLOG_ENTRY_OVERHEAD
+#error "BACKLOG_BATCH_LEN cannot hold a full frame"
+#endif
+
+/**
+ * \brief Start the drain process
+ * \param conn Connection the batches are sent on, towards the DODAG root
+ */
+void backlog_init(struct simple_udp_connection *conn);
+
+/** \brief Sequence number for the next telemetry frame */
+uint16_t backlog_next_seq(void);
+
+/**
+ * \brief Start a telemetry frame with the boot count and the next seq
+ * \return 1 on success, 0 if the frame is full
+ */
+int backlog_put_seq(farm_frame_writer_t *w);
+
+/**
+ * \brief Hold a frame until the node can reach the border router
+ * \return 1 on success, 0 if the frame is not a valid frame
+ *
+ * A full backlog drops its oldest frame to make room.
+ */
+int backlog_put(const uint8_t *frame, uint16_t len);
+
+/**
+ * \brief Send a frame to the DODAG root, or queue it behind held frames
+ * \return 1 if the frame went out right away
+ */
+int backlog_send(const uint8_t *frame, uint16_t len, const uip_ipaddr_t *dest);
+
+/**
+ * \brief Hand a datagram from the border router to the backlog
+ * \return 1 if it was a telemetry ack, 0 otherwise
+ */
+int backlog_input(const uint8_t *data, uint16_t len);
+
+/** \brief Number of frames held */
+uint16_t backlog_count(void);
+
+/** \brief Frames dropped from a full backlog since boot */
+uint32_t backlog_dropped(void);
+
+/** \brief Frames sent again after an ack showed them lost */
+uint32_t backlog_retransmitted(void);
+
+#endif /* BACKLOG_H_ */
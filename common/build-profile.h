@@ -0,0 +1,41 @@
+/**
+ * \file
+ *      Debug and production builds of the sensor nodes.
+ *
+ *      Included from project-conf.h. The default debug build logs the app
+ *      at LOG_LEVEL_DBG. "make PRODUCTION=1" compiles every log call of
+ *      the app, the farm modules and the stack out and records the events
+ *      in the trace ring (trace.h) instead. The shell stays in both.
+ */
+
+#ifndef BUILD_PROFILE_H_
+#define BUILD_PROFILE_H_
+
+#ifndef FARM_CONF_PRODUCTION
+#define FARM_CONF_PRODUCTION           0
+#endif
+
+#if FARM_CONF_PRODUCTION
+
+#define LOG_LEVEL_APP                  LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_FARM            LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_MAIN            LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_RPL             LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_TCPIP           LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_IPV6            LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_6LOWPAN         LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_MAC             LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_FRAMER          LOG_LEVEL_NONE
+#define LOG_CONF_LEVEL_COAP            LOG_LEVEL_NONE
+
+#ifndef TRACE_CONF_ON
+#define TRACE_CONF_ON                  1
+#endif
+
+#else /* FARM_CONF_PRODUCTION */
+
+#define LOG_LEVEL_APP                  LOG_LEVEL_DBG
+
+#endif /* FARM_CONF_PRODUCTION */
+
+#endif /* BUILD_PROFILE_H_ */
@@ -0,0 +1,241 @@
+/**
+ * \file
+ *      Minimal CBOR encoder with SenML helpers.
+ */
+
+#include "cbor.h"
+#include "net/linkaddr.h"
+
+#include <string.h>
+
+#define MAJOR_UINT                0x00
+#define MAJOR_NEGATIVE            0x20
+#define MAJOR_TEXT                0x60
+#define MAJOR_ARRAY               0x80
+#define MAJOR_MAP                 0xa0
+
+#define SIMPLE_FALSE              0xf4
+#define SIMPLE_TRUE               0xf5
+#define FLOAT_HALF                0xf9
+#define FLOAT_SINGLE              0xfa
+
+static const int32_t powers_of_ten[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+/*---------------------------------------------------------------------------*/
+static int
+reserve(cbor_writer_t *w, uint16_t len)
+{
+  if(w->overflow || w->len + len > w->size) {
+    w->overflow = 1;
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Big-endian tail of a head or a float, n bytes */
+static void
+put_be(cbor_writer_t *w, uint32_t value, uint8_t n)
+{
+  while(n-- > 0) {
+    w->buf[w->len++] = (uint8_t)(value >> (8 * n));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Initial byte and argument in the shortest form */
+static void
+put_head(cbor_writer_t *w, uint8_t major, uint32_t arg)
+{
+  uint8_t n;
+  uint8_t info;
+
+  if(arg < 24) {
+    n = 0;
+    info = (uint8_t)arg;
+  } else if(arg <= UINT8_MAX) {
+    n = 1;
+    info = 24;
+  } else if(arg <= UINT16_MAX) {
+    n = 2;
+    info = 25;
+  } else {
+    n = 4;
+    info = 26;
+  }
+
+  if(reserve(w, 1 + n)) {
+    w->buf[w->len++] = major | info;
+    put_be(w, arg, n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Half precision of a single precision float, if it is exact */
+static int
+to_half(uint32_t f, uint16_t *half)
+{
+  uint16_t sign = (uint16_t)((f >> 16) & 0x8000);
+  int16_t exp = (int16_t)((f >> 23) & 0xff);
+  uint32_t mant = f & 0x7fffff;
+
+  if(exp == 0 && mant == 0) {
+    *half = sign;
+    return 1;
+  }
+  /* Normal halves only, and no mantissa bits lost */
+  if(exp < 127 - 14 || exp > 127 + 15 || (mant & 0x1fff) != 0) {
+    return 0;
+  }
+  *half = sign | (uint16_t)((exp - 127 + 15) << 10) | (uint16_t)(mant >> 13);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_init(cbor_writer_t *w, uint8_t *buf, uint16_t size)
+{
+  w->buf = buf;
+  w->size = size;
+  w->len = 0;
+  w->overflow = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_put_uint(cbor_writer_t *w, uint32_t value)
+{
+  put_head(w, MAJOR_UINT, value);
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_put_int(cbor_writer_t *w, int32_t value)
+{
+  if(value < 0) {
+    /* -1 - n, which also covers INT32_MIN */
+    put_head(w, MAJOR_NEGATIVE, (uint32_t)(-(value + 1)));
+  } else {
+    put_head(w, MAJOR_UINT, (uint32_t)value);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_put_bool(cbor_writer_t *w, int value)
+{
+  if(reserve(w, 1)) {
+    w->buf[w->len++] = value ? SIMPLE_TRUE : SIMPLE_FALSE;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_put_text(cbor_writer_t *w, const char *text)
+{
+  uint16_t len = (uint16_t)strlen(text);
+
+  put_head(w, MAJOR_TEXT, len);
+  if(reserve(w, len)) {
+    memcpy(&w->buf[w->len], text, len);
+    w->len += len;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_put_array(cbor_writer_t *w, uint16_t count)
+{
+  put_head(w, MAJOR_ARRAY, count);
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_put_map(cbor_writer_t *w, uint16_t pairs)
+{
+  put_head(w, MAJOR_MAP, pairs);
+}
+/*---------------------------------------------------------------------------*/
+void
+cbor_put_fixed(cbor_writer_t *w, int32_t value, uint8_t decimals)
+{
+  float f;
+  uint32_t bits;
+  uint16_t half;
+
+  if(decimals >= sizeof(powers_of_ten) / sizeof(powers_of_ten[0])) {
+    w->overflow = 1;
+    return;
+  }
+  if(value % powers_of_ten[decimals] == 0) {
+    cbor_put_int(w, value / powers_of_ten[decimals]);
+    return;
+  }
+
+  f = (float)value / powers_of_ten[decimals];
+  memcpy(&bits, &f, sizeof(bits));
+  if(to_half(bits, &half)) {
+    if(reserve(w, 3)) {
+      w->buf[w->len++] = FLOAT_HALF;
+      put_be(w, half, 2);
+    }
+  } else if(reserve(w, 5)) {
+    w->buf[w->len++] = FLOAT_SINGLE;
+    put_be(w, bits, 4);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+cbor_len(const cbor_writer_t *w)
+{
+  return w->overflow ? -1 : w->len;
+}
+/*---------------------------------------------------------------------------*/
+const char *
+senml_base_name(void)
+{
+  static char name[SENML_BASE_NAME_LEN + 1];
+  static const char hex[] = "0123456789abcdef";
+  char *p;
+  int i;
+
+  /* The address is set before any process runs, format it once */
+  if(name[0] == '\0') {
+    memcpy(name, "urn:dev:mac:", 12);
+    p = &name[12];
+    for(i = 0; i < LINKADDR_SIZE && i < 8; i++) {
+      *p++ = hex[linkaddr_node_addr.u8[i] >> 4];
+      *p++ = hex[linkaddr_node_addr.u8[i] & 0x0f];
+    }
+    *p++ = ':';
+    *p = '\0';
+  }
+  return name;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_record_head(cbor_writer_t *w, const char *base_name, const char *name,
+                const char *unit)
+{
+  cbor_put_map(w, (base_name ? 1 : 0) + 1 + (unit ? 1 : 0) + 1);
+  if(base_name) {
+    cbor_put_int(w, SENML_BASE_NAME);
+    cbor_put_text(w, base_name);
+  }
+  cbor_put_int(w, SENML_NAME);
+  cbor_put_text(w, name);
+  if(unit) {
+    cbor_put_int(w, SENML_UNIT);
+    cbor_put_text(w, unit);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+senml_put_value(cbor_writer_t *w, const char *base_name, const char *name,
+                const char *unit, int32_t value, uint8_t decimals)
+{
+  put_record_head(w, base_name, name, unit);
+  cbor_put_int(w, SENML_VALUE);
+  cbor_put_fixed(w, value, decimals);
+}
+/*---------------------------------------------------------------------------*/
+void
+senml_put_bool(cbor_writer_t *w, const char *base_name, const char *name,
+               int value)
+{
+  put_record_head(w, base_name, name, NULL);
+  cbor_put_int(w, SENML_BOOL_VALUE);
+  cbor_put_bool(w, value);
+}
+/*---------------------------------------------------------------------------*/
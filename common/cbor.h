@@ -0,0 +1,78 @@
+/**
+ * \file
+ *      Minimal CBOR (RFC 8949) encoder with SenML (RFC 8428) helpers.
+ *
+ *      Items are written straight into a buffer owned by the caller, the
+ *      writer keeps no other state and never allocates. Arrays and maps
+ *      have definite lengths, so the caller gives the item count up front.
+ *      A write that does not fit sets the overflow flag and is dropped,
+ *      cbor_len() then reports the whole encoding as failed.
+ */
+
+#ifndef CBOR_H_
+#define CBOR_H_
+
+#include "contiki.h"
+
+/* SenML labels of the CBOR representation */
+#define SENML_BASE_NAME           (-2)
+#define SENML_NAME                0
+#define SENML_UNIT                1
+#define SENML_VALUE               2
+#define SENML_BOOL_VALUE          4
+
+/* "urn:dev:mac:" and the EUI-64 in hex, ending with ':' */
+#define SENML_BASE_NAME_LEN       (12 + 16 + 1)
+
+typedef struct cbor_writer {
+  uint8_t *buf;
+  uint16_t size;
+  uint16_t len;
+  uint8_t overflow;
+} cbor_writer_t;
+
+void cbor_init(cbor_writer_t *w, uint8_t *buf, uint16_t size);
+
+void cbor_put_uint(cbor_writer_t *w, uint32_t value);
+
+void cbor_put_int(cbor_writer_t *w, int32_t value);
+
+void cbor_put_bool(cbor_writer_t *w, int value);
+
+/** \brief Text string, without the terminator */
+void cbor_put_text(cbor_writer_t *w, const char *text);
+
+/** \brief Array header, followed by count items */
+void cbor_put_array(cbor_writer_t *w, uint16_t count);
+
+/** \brief Map header, followed by pairs keys and values */
+void cbor_put_map(cbor_writer_t *w, uint16_t pairs);
+
+/**
+ * \brief Fixed-point value, value / 10^decimals
+ *
+ * Whole numbers go out as integers, others as the shortest float that
+ * holds the single precision value.
+ */
+void cbor_put_fixed(cbor_writer_t *w, int32_t value, uint8_t decimals);
+
+/** \return Length of the encoding, -1 if it did not fit */
+int cbor_len(const cbor_writer_t *w);
+
+/** \brief SenML base name of this node, from its link-layer address */
+const char *senml_base_name(void);
+
+/**
+ * \brief One SenML record with a numeric value
+ * \param base_name Given on the first record of a pack only, else NULL
+ * \param unit      SenML unit, NULL for none
+ */
+void senml_put_value(cbor_writer_t *w, const char *base_name,
+                     const char *name, const char *unit,
+                     int32_t value, uint8_t decimals);
+
+/** \brief One SenML record with a boolean value */
+void senml_put_bool(cbor_writer_t *w, const char *base_name,
+                    const char *name, int value);
+
+#endif /* CBOR_H_ */
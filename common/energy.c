@@ -0,0 +1,107 @@
+/**
+ * \file
+ *      Energest time of each report period on a sensor node.
+ */
+
+#include "energy.h"
+#include "sys/energest.h"
+#if ENERGY_TELEMETRY
+#include "backlog.h"
+#include "net/routing/routing.h"
+#endif
+
+#include <string.h>
+
+/* Energest totals at the start of the current period */
+static uint64_t start_total;
+static uint64_t start[ENERGEST_TYPE_MAX];
+static energy_t last;
+/*---------------------------------------------------------------------------*/
+static uint32_t
+to_energy(uint64_t ticks)
+{
+  return (uint32_t)(ticks * ENERGY_SECOND / ENERGEST_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+/* Time in one state since the start of the period, and restart it */
+static uint32_t
+delta(energest_type_t type)
+{
+  uint64_t now = energest_type_time(type);
+  uint32_t d = to_energy(now - start[type]);
+
+  start[type] = now;
+  return d;
+}
+/*---------------------------------------------------------------------------*/
+void
+energy_init(void)
+{
+  int i;
+
+  energest_flush();
+  for(i = 0; i < ENERGEST_TYPE_MAX; i++) {
+    start[i] = energest_type_time(i);
+  }
+  start_total = ENERGEST_GET_TOTAL_TIME();
+  memset(&last, 0, sizeof(last));
+}
+/*---------------------------------------------------------------------------*/
+const energy_t *
+energy_update(void)
+{
+  uint64_t total;
+
+  energest_flush();
+  total = ENERGEST_GET_TOTAL_TIME();
+  last.period = to_energy(total - start_total);
+  start_total = total;
+
+  last.cpu = delta(ENERGEST_TYPE_CPU);
+  last.lpm = delta(ENERGEST_TYPE_LPM);
+  last.deep_lpm = delta(ENERGEST_TYPE_DEEP_LPM);
+  last.listen = delta(ENERGEST_TYPE_LISTEN);
+  last.transmit = delta(ENERGEST_TYPE_TRANSMIT);
+  return &last;
+}
+/*---------------------------------------------------------------------------*/
+const energy_t *
+energy_last(void)
+{
+  return &last;
+}
+/*---------------------------------------------------------------------------*/
+int
+energy_put(farm_frame_writer_t *w, const energy_t *e)
+{
+  return farm_frame_put_int(w, FARM_TLV_ENERGY_PERIOD, (int32_t)e->period)
+    && farm_frame_put_int(w, FARM_TLV_ENERGY_CPU, (int32_t)e->cpu)
+    && farm_frame_put_int(w, FARM_TLV_ENERGY_LPM, (int32_t)e->lpm)
+    && farm_frame_put_int(w, FARM_TLV_ENERGY_DEEP_LPM, (int32_t)e->deep_lpm)
+    && farm_frame_put_int(w, FARM_TLV_ENERGY_LISTEN, (int32_t)e->listen)
+    && farm_frame_put_int(w, FARM_TLV_ENERGY_TRANSMIT, (int32_t)e->transmit);
+}
+/*---------------------------------------------------------------------------*/
+void
+energy_report(uint8_t node_class)
+{
+#if ENERGY_TELEMETRY
+  static uint8_t frame[FARM_FRAME_MAX_LEN];
+  farm_frame_writer_t w;
+  uip_ipaddr_t dest_ipaddr;
+
+  farm_frame_begin(&w, frame, sizeof(frame), FARM_MSG_TELEMETRY, node_class);
+  backlog_put_seq(&w);
+  if(!energy_put(&w, &last)) {
+    return;
+  }
+
+  if(NETSTACK_ROUTING.node_is_reachable() &&
+     NETSTACK_ROUTING.get_root_ipaddr(&dest_ipaddr)) {
+    backlog_send(frame, farm_frame_len(&w), &dest_ipaddr);
+  } else {
+    backlog_put(frame, farm_frame_len(&w));
+  }
+#endif /* ENERGY_TELEMETRY */
+}
+/*---------------------------------------------------------------------------*/
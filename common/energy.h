@@ -0,0 +1,60 @@
+/**
+ * \file
+ *      Energest time of each report period on a sensor node.
+ *
+ *      energy_update() closes a period: it flushes energest and keeps the
+ *      time spent in each state since the previous call. The times are in
+ *      1/1024 s rather than energest ticks so that a period of a day still
+ *      fits in 32 bits, which is about one millisecond of resolution.
+ *
+ *      With ENERGY_CONF_TELEMETRY the node also sends every period to the
+ *      border router, as a telemetry frame of FARM_TLV_ENERGY_* records
+ *      next to the readings. The readings frame has no room left for them
+ *      on the environment and multi-probe nodes.
+ */
+
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include "contiki.h"
+#include "farm-frame.h"
+
+#ifdef ENERGY_CONF_TELEMETRY
+#define ENERGY_TELEMETRY          ENERGY_CONF_TELEMETRY
+#else
+#define ENERGY_TELEMETRY          0
+#endif
+
+/* Unit of every energy_t field, as sent in the FARM_TLV_ENERGY_* records */
+#define ENERGY_SECOND             FARM_ENERGY_SECOND
+
+typedef struct energy {
+  uint32_t period;            /* Length of the period */
+  uint32_t cpu;
+  uint32_t lpm;
+  uint32_t deep_lpm;
+  uint32_t listen;
+  uint32_t transmit;
+} energy_t;
+
+/** \brief Start the first period */
+void energy_init(void);
+
+/** \brief Close the current period and start the next one */
+const energy_t *energy_update(void);
+
+/** \brief The period closed last, all zero before the first update */
+const energy_t *energy_last(void);
+
+/** \brief Append a period to a frame as FARM_TLV_ENERGY_* records */
+int energy_put(farm_frame_writer_t *w, const energy_t *e);
+
+/**
+ * \brief Send the last period to the border router
+ *
+ * Goes through the backlog like the readings, held while the node is
+ * unreachable. Does nothing without ENERGY_TELEMETRY.
+ */
+void energy_report(uint8_t node_class);
+
+#endif /* ENERGY_H_ */
@@ -0,0 +1,144 @@
+/**
+ * \file
+ *      Compact binary telemetry frame encoder and decoder.
+ */
+
+#include "farm-frame.h"
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+static uint8_t
+int_len(int32_t value)
+{
+  if(value >= INT8_MIN && value <= INT8_MAX) {
+    return 1;
+  }
+  if(value >= INT16_MIN && value <= INT16_MAX) {
+    return 2;
+  }
+  if(value >= -0x800000L && value <= 0x7fffffL) {
+    return 3;
+  }
+  return 4;
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_frame_begin(farm_frame_writer_t *w, uint8_t *buf, uint16_t size,
+                 uint8_t msg_type, uint8_t node_class)
+{
+  w->buf = buf;
+  w->size = size;
+  w->len = 0;
+
+  if(size < FARM_FRAME_HDR_LEN) {
+    return 0;
+  }
+
+  buf[0] = FARM_FRAME_VERSION;
+  buf[1] = msg_type;
+  buf[2] = node_class;
+  w->len = FARM_FRAME_HDR_LEN;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_frame_put_int(farm_frame_writer_t *w, uint8_t type, int32_t value)
+{
+  uint8_t len = int_len(value);
+  uint8_t *p;
+  int i;
+
+  if(w->len + FARM_FRAME_TLV_HDR_LEN + len > w->size) {
+    return 0;
+  }
+
+  p = &w->buf[w->len];
+  p[0] = type;
+  p[1] = len;
+  for(i = len - 1; i >= 0; i--) {
+    p[FARM_FRAME_TLV_HDR_LEN + i] = (uint8_t)value;
+    value >>= 8;
+  }
+  w->len += FARM_FRAME_TLV_HDR_LEN + len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_frame_put_bytes(farm_frame_writer_t *w, uint8_t type,
+                     const void *data, uint8_t len)
+{
+  uint8_t *p;
+
+  if(w->len + FARM_FRAME_TLV_HDR_LEN + len > w->size) {
+    return 0;
+  }
+
+  p = &w->buf[w->len];
+  p[0] = type;
+  p[1] = len;
+  memcpy(&p[FARM_FRAME_TLV_HDR_LEN], data, len);
+  w->len += FARM_FRAME_TLV_HDR_LEN + len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_frame_open(farm_frame_reader_t *r, const uint8_t *data, uint16_t len)
+{
+  uint16_t pos;
+
+  if(data == NULL || len < FARM_FRAME_HDR_LEN
+     || data[0] != FARM_FRAME_VERSION) {
+    return 0;
+  }
+
+  /* Every record header and value must lie inside the datagram */
+  for(pos = FARM_FRAME_HDR_LEN; pos < len;
+      pos += FARM_FRAME_TLV_HDR_LEN + data[pos + 1]) {
+    if(pos + FARM_FRAME_TLV_HDR_LEN > len
+       || pos + FARM_FRAME_TLV_HDR_LEN + data[pos + 1] > len) {
+      return 0;
+    }
+  }
+
+  r->buf = data;
+  r->len = len;
+  r->pos = FARM_FRAME_HDR_LEN;
+  r->msg_type = data[1];
+  r->node_class = data[2];
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_frame_next(farm_frame_reader_t *r, farm_tlv_t *tlv)
+{
+  if(r->pos >= r->len) {
+    return 0;
+  }
+
+  tlv->type = r->buf[r->pos];
+  tlv->len = r->buf[r->pos + 1];
+  tlv->value = &r->buf[r->pos + FARM_FRAME_TLV_HDR_LEN];
+  r->pos += FARM_FRAME_TLV_HDR_LEN + tlv->len;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+farm_tlv_int(const farm_tlv_t *tlv, int32_t *value)
+{
+  uint32_t v;
+  uint8_t i;
+
+  if(tlv->len < 1 || tlv->len > 4) {
+    return 0;
+  }
+
+  /* Sign-extend from the first byte, then shift the rest in */
+  v = (tlv->value[0] & 0x80) ? 0xffffffffUL : 0;
+  for(i = 0; i < tlv->len; i++) {
+    v = (v << 8) | tlv->value[i];
+  }
+  *value = (int32_t)v;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
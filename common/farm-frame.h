@@ -0,0 +1,192 @@
+/**
+ * \file
+ *      Compact binary telemetry frame shared by the farm nodes and the
+ *      border router.
+ *
+ *      A frame is a fixed header followed by type-length-value records:
+ *
+ *        +---------+----------+------------+------+-----+-------+ ...
+ *        | version | msg type | node class | type | len | value | ...
+ *        +---------+----------+------------+------+-----+-------+ ...
+ *
+ *      Integer values are big-endian two's complement and use the
+ *      fewest bytes (1-4) that hold them.
+ */
+
+#ifndef FARM_FRAME_H_
+#define FARM_FRAME_H_
+
+#include <stdint.h>
+
+#define FARM_FRAME_VERSION        1
+#define FARM_FRAME_HDR_LEN        3
+#define FARM_FRAME_TLV_HDR_LEN    2
+
+/* Large enough for every node class, small enough to never fragment */
+#ifdef FARM_FRAME_CONF_MAX_LEN
+#define FARM_FRAME_MAX_LEN        FARM_FRAME_CONF_MAX_LEN
+#else
+#define FARM_FRAME_MAX_LEN        72
+#endif
+
+/* Message types */
+#define FARM_MSG_TELEMETRY        0x01
+#define FARM_MSG_POLL             0x02  /* Actuator asks for its state */
+#define FARM_MSG_COMMAND          0x03  /* Border router sets an actuator */
+#define FARM_MSG_ACK              0x04  /* Actuator confirms a command */
+#define FARM_MSG_BATCH            0x05  /* FARM_TLV_FRAME records held on a
+                                           node while it was unreachable */
+#define FARM_MSG_TELEMETRY_ACK    0x06  /* Border router confirms the
+                                           telemetry sequence numbers */
+
+/* Node classes */
+#define FARM_NODE_ENV             0x01  /* HDC1000 + OPT3001 */
+#define FARM_NODE_WATER_TEMP      0x02  /* DS18B20 */
+#define FARM_NODE_EC              0x03  /* Atlas EZO-EC */
+#define FARM_NODE_PH              0x04  /* Atlas EZO-pH */
+#define FARM_NODE_FLOAT_SWITCH    0x05
+#define FARM_NODE_NUTRIENT_PUMP   0x06
+#define FARM_NODE_GROWLIGHT       0x07
+
+/* TLV types */
+#define FARM_TLV_TEMPERATURE      0x01  /* int, 0.01 deg C */
+#define FARM_TLV_HUMIDITY         0x02  /* int, 0.01 %RH */
+#define FARM_TLV_LIGHT            0x03  /* int, 0.01 lux */
+#define FARM_TLV_WATER_TEMP       0x04  /* int, 0.01 deg C */
+#define FARM_TLV_EC               0x05  /* int, uS/cm */
+/* 0x06 carried the raw EZO-pH text, retired */
+#define FARM_TLV_FLOAT_SWITCH     0x07  /* int, 1 = water level low */
+#define FARM_TLV_COMMAND_ID       0x08  /* int, echoed back in the ack */
+#define FARM_TLV_ACTUATOR_STATE   0x09  /* int, FARM_ACTUATOR_* bits */
+#define FARM_TLV_PROBE            0x0A  /* int, probe index of the next
+                                           record, 0 when absent */
+#define FARM_TLV_READS            0x0B  /* int, sensor reads since boot */
+#define FARM_TLV_CRC_ERRORS       0x0C  /* int, reads that failed the CRC */
+#define FARM_TLV_PH               0x0D  /* int, 0.001 pH */
+#define FARM_TLV_WINDOW_SAMPLES   0x0E  /* int, samples behind the window
+                                           statistics in this frame */
+#define FARM_TLV_AGE              0x0F  /* int, seconds the frame was held on
+                                           the node before it was sent */
+#define FARM_TLV_FRAME            0x10  /* bytes, a complete nested frame */
+#define FARM_TLV_SEQ              0x11  /* int, 16-bit sequence number of the
+                                           frame, or the cumulative ack */
+#define FARM_TLV_SEQ_RECEIVED     0x12  /* int, bit n set: frame seq + 1 + n
+                                           arrived after the cumulative ack */
+/* Energest time of one report period on the node, in 1/FARM_ENERGY_SECOND s */
+#define FARM_ENERGY_SECOND        1024
+#define FARM_TLV_ENERGY_PERIOD    0x13  /* int, length of the period */
+#define FARM_TLV_ENERGY_CPU       0x14  /* int, CPU active */
+#define FARM_TLV_ENERGY_LPM       0x15  /* int, low-power mode */
+#define FARM_TLV_ENERGY_DEEP_LPM  0x16  /* int, deep low-power mode */
+#define FARM_TLV_ENERGY_LISTEN    0x17  /* int, radio listening */
+#define FARM_TLV_ENERGY_TRANSMIT  0x18  /* int, radio transmitting */
+#define FARM_TLV_ENERGY_RECORDS   6
+#define FARM_TLV_BOOT             0x19  /* int, boot count of the node, any
+                                           change means it restarted */
+
+/*
+ * Statistics over a report window reuse the type of the channel, with a
+ * modifier in the top two bits. Plain types stay below 0x40.
+ */
+#define FARM_TLV_MIN(t)           (0x40 | (t))
+#define FARM_TLV_MAX(t)           (0x80 | (t))
+#define FARM_TLV_MEAN(t)          (0xC0 | (t))
+#define FARM_TLV_STAT_MASK        0xC0
+
+/*
+ * With telemetry acks the border router answers every telemetry or batch
+ * datagram, and the nodes keep each frame until it is acknowledged. Set
+ * it the same way on the border router and on the sensor nodes.
+ */
+#ifdef FARM_CONF_TELEMETRY_ACK
+#define FARM_TELEMETRY_ACK        FARM_CONF_TELEMETRY_ACK
+#else
+#define FARM_TELEMETRY_ACK        0
+#endif
+
+/* Actuator state bits */
+#define FARM_ACTUATOR_PUMP        0x01  /* Water or nutrient pump on */
+#define FARM_ACTUATOR_GROWLIGHT   0x02  /* Grow light on */
+
+typedef struct farm_frame_writer {
+  uint8_t *buf;
+  uint16_t size;
+  uint16_t len;
+} farm_frame_writer_t;
+
+typedef struct farm_frame_reader {
+  const uint8_t *buf;
+  uint16_t len;
+  uint16_t pos;
+  uint8_t msg_type;
+  uint8_t node_class;
+} farm_frame_reader_t;
+
+typedef struct farm_tlv {
+  uint8_t type;
+  uint8_t len;
+  const uint8_t *value;
+} farm_tlv_t;
+
+/**
+ * \brief Start a new frame in buf
+ * \return 1 on success, 0 if buf cannot hold the header
+ */
+int farm_frame_begin(farm_frame_writer_t *w, uint8_t *buf, uint16_t size,
+                     uint8_t msg_type, uint8_t node_class);
+
+/**
+ * \brief Append an integer record using the shortest encoding
+ * \return 1 on success, 0 if the frame is full
+ */
+int farm_frame_put_int(farm_frame_writer_t *w, uint8_t type, int32_t value);
+
+/**
+ * \brief Append an opaque record of len bytes
+ * \return 1 on success, 0 if the frame is full
+ */
+int farm_frame_put_bytes(farm_frame_writer_t *w, uint8_t type,
+                         const void *data, uint8_t len);
+
+static inline uint16_t
+farm_frame_len(const farm_frame_writer_t *w)
+{
+  return w->len;
+}
+
+/** \brief Append a sequence number, at most two value bytes */
+static inline int
+farm_frame_put_seq(farm_frame_writer_t *w, uint8_t type, uint16_t seq)
+{
+  return farm_frame_put_int(w, type, (int16_t)seq);
+}
+
+/** \brief Distance from sequence number b to a, negative if a is older */
+static inline int16_t
+farm_seq_diff(uint16_t a, uint16_t b)
+{
+  return (int16_t)(a - b);
+}
+
+/**
+ * \brief Check the header and walk every record of a received frame
+ * \return 1 if the whole frame is well formed, 0 otherwise
+ *
+ * Records can only be read with farm_frame_next() after a successful open,
+ * which means a handler never acts on half of a truncated frame.
+ */
+int farm_frame_open(farm_frame_reader_t *r, const uint8_t *data, uint16_t len);
+
+/**
+ * \brief Fetch the next record
+ * \return 1 if tlv was filled in, 0 at the end of the frame
+ */
+int farm_frame_next(farm_frame_reader_t *r, farm_tlv_t *tlv);
+
+/**
+ * \brief Decode an integer record
+ * \return 1 on success, 0 if the record is not 1-4 bytes long
+ */
+int farm_tlv_int(const farm_tlv_t *tlv, int32_t *value);
+
+#endif /* FARM_FRAME_H_ */
@@ -0,0 +1,210 @@
+/**
+ * \file
+ *      Sampling and reporting intervals of a sensor node, set at run time.
+ */
+
+#include "node-config.h"
+#include "trace.h"
+#if NODE_CONFIG_WITH_CFS
+#include "cfs/cfs.h"
+#else
+#include "random.h"
+#endif
+
+#include "sys/log.h"
+#define LOG_MODULE "Config"
+#ifdef LOG_CONF_LEVEL_FARM
+#define LOG_LEVEL LOG_CONF_LEVEL_FARM
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define NODE_CONFIG_FILE          "config"
+#define NODE_CONFIG_BOOT_FILE     "boots"
+/* Changes whenever node_config_t does */
+#define NODE_CONFIG_MAGIC         0x4e43
+
+typedef struct saved_config {
+  uint16_t magic;
+  node_config_t config;
+} saved_config_t;
+
+static node_config_t current;
+static uint8_t boot;
+static wake_job_t *sample_job;
+static wake_job_t *report_job;
+/*---------------------------------------------------------------------------*/
+static int
+valid(const node_config_t *c)
+{
+  return c->sample_interval >= NODE_CONFIG_SAMPLE_MIN
+    && c->sample_interval <= NODE_CONFIG_SAMPLE_MAX
+    && c->report_interval >= NODE_CONFIG_REPORT_MIN
+    && c->report_interval <= NODE_CONFIG_REPORT_MAX
+    && c->report_interval >= c->sample_interval;
+}
+/*---------------------------------------------------------------------------*/
+#if NODE_CONFIG_WITH_CFS
+static int
+load(node_config_t *c)
+{
+  saved_config_t saved;
+  int fd;
+  int ok;
+
+  fd = cfs_open(NODE_CONFIG_FILE, CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  ok = cfs_read(fd, &saved, sizeof(saved)) == sizeof(saved)
+    && saved.magic == NODE_CONFIG_MAGIC && valid(&saved.config);
+  cfs_close(fd);
+
+  if(ok) {
+    *c = saved.config;
+  }
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+static int
+save(const node_config_t *c)
+{
+  saved_config_t saved;
+  int fd;
+  int ok;
+
+  saved.magic = NODE_CONFIG_MAGIC;
+  saved.config = *c;
+
+  cfs_remove(NODE_CONFIG_FILE);
+  fd = cfs_open(NODE_CONFIG_FILE, CFS_WRITE);
+  if(fd < 0) {
+    return 0;
+  }
+  ok = cfs_write(fd, &saved, sizeof(saved)) == sizeof(saved);
+  cfs_close(fd);
+  return ok;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+count_boot(void)
+{
+  uint8_t b = 0;
+  int fd;
+
+  fd = cfs_open(NODE_CONFIG_BOOT_FILE, CFS_READ);
+  if(fd >= 0) {
+    cfs_read(fd, &b, sizeof(b));
+    cfs_close(fd);
+  }
+  b = (b + 1) & NODE_CONFIG_BOOT_MASK;
+
+  cfs_remove(NODE_CONFIG_BOOT_FILE);
+  fd = cfs_open(NODE_CONFIG_BOOT_FILE, CFS_WRITE);
+  if(fd < 0 || cfs_write(fd, &b, sizeof(b)) != sizeof(b)) {
+    LOG_ERR("Cannot save %s\n", NODE_CONFIG_BOOT_FILE);
+  }
+  if(fd >= 0) {
+    cfs_close(fd);
+  }
+  return b;
+}
+#else
+/*---------------------------------------------------------------------------*/
+static int
+load(node_config_t *c)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+save(const node_config_t *c)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Nothing to count in, a random value changes on most boots */
+static uint8_t
+count_boot(void)
+{
+  return random_rand() & NODE_CONFIG_BOOT_MASK;
+}
+#endif /* NODE_CONFIG_WITH_CFS */
+/*---------------------------------------------------------------------------*/
+void
+node_config_init(wake_job_t *sampler, wake_job_t *reporter,
+                 uint32_t sample_interval, uint32_t report_interval)
+{
+  sample_job = sampler;
+  report_job = reporter;
+  boot = count_boot();
+
+  if(load(&current)) {
+    LOG_INFO("Sample every %lu s, report every %lu s\n",
+             (unsigned long)current.sample_interval,
+             (unsigned long)current.report_interval);
+    return;
+  }
+  current.sample_interval = sample_interval;
+  current.report_interval = report_interval;
+}
+/*---------------------------------------------------------------------------*/
+const node_config_t *
+node_config_get(void)
+{
+  return &current;
+}
+/*---------------------------------------------------------------------------*/
+int
+node_config_set(const node_config_t *config)
+{
+  if(!valid(config)) {
+    return 0;
+  }
+  current = *config;
+
+  /* The running jobs pick the new intervals up from the next window */
+  if(sample_job != NULL) {
+    wake_set_every(sample_job, node_config_sample_windows());
+  }
+  if(report_job != NULL) {
+    wake_set_every(report_job, node_config_report_windows());
+  }
+
+  if(!save(&current)) {
+    LOG_ERR("Cannot save %s, applied until reboot\n", NODE_CONFIG_FILE);
+  }
+  LOG_INFO("Sample every %lu s, report every %lu s\n",
+           (unsigned long)current.sample_interval,
+           (unsigned long)current.report_interval);
+  TRACE(TRACE_CONFIG, current.sample_interval, current.report_interval);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+node_config_boot(void)
+{
+  return boot;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+node_config_sample_windows(void)
+{
+  return WAKE_WINDOWS(current.sample_interval * CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+node_config_report_windows(void)
+{
+  return WAKE_WINDOWS(current.report_interval * CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+node_config_sample_time(void)
+{
+  if(current.sample_interval * CLOCK_SECOND < WAKE_PERIOD) {
+    return current.sample_interval * CLOCK_SECOND;
+  }
+  return node_config_sample_windows() * WAKE_PERIOD;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,96 @@
+/**
+ * \file
+ *      Sampling and reporting intervals of a sensor node, set at run time.
+ *
+ *      The intervals are whole seconds. They are kept in a CFS file so
+ *      they survive a reboot, and applied to the jobs of the wake-up
+ *      scheduler right away, rounded to whole windows. The sampling
+ *      interval is the time between two readings, the reporting interval
+ *      the heartbeat: change reports still go out as soon as a value
+ *      moves.
+ *
+ *      The node also counts its boots in a second file, which the border
+ *      router uses to tell a restart from late frames.
+ *
+ *      Persisting needs MODULES += $(CONTIKI_NG_STORAGE_DIR)/cfs in the
+ *      Makefile. Without NODE_CONFIG_CONF_WITH_CFS the settings last
+ *      until the next reboot.
+ */
+
+#ifndef NODE_CONFIG_H_
+#define NODE_CONFIG_H_
+
+#include "contiki.h"
+#include "wake.h"
+
+#ifdef NODE_CONFIG_CONF_WITH_CFS
+#define NODE_CONFIG_WITH_CFS      NODE_CONFIG_CONF_WITH_CFS
+#else
+#define NODE_CONFIG_WITH_CFS      1
+#endif
+
+/*
+ * Bounds in seconds. The shortest sample is one wake-up window unless the
+ * node samples between windows itself, see node_config_sample_time().
+ */
+#ifdef NODE_CONFIG_CONF_SAMPLE_MIN
+#define NODE_CONFIG_SAMPLE_MIN    NODE_CONFIG_CONF_SAMPLE_MIN
+#else
+#define NODE_CONFIG_SAMPLE_MIN    (WAKE_PERIOD / CLOCK_SECOND)
+#endif
+#define NODE_CONFIG_SAMPLE_MAX    (60UL * 60)
+#define NODE_CONFIG_REPORT_MIN    60UL
+#define NODE_CONFIG_REPORT_MAX    (24UL * 60 * 60)
+
+/* The boot count wraps here, so it always fits one byte of a frame */
+#define NODE_CONFIG_BOOT_MASK     0x7f
+
+typedef struct node_config {
+  uint32_t sample_interval;   /* Seconds between two readings */
+  uint32_t report_interval;   /* Seconds between two heartbeats */
+} node_config_t;
+
+/**
+ * \brief Load the saved intervals, or take the defaults
+ * \param sampler  Sampling job, NULL for a node without one
+ * \param reporter Reporting job
+ *
+ * Call before the jobs are added to the scheduler, and add them with
+ * node_config_sample_windows() and node_config_report_windows().
+ */
+void node_config_init(wake_job_t *sampler, wake_job_t *reporter,
+                      uint32_t sample_interval, uint32_t report_interval);
+
+const node_config_t *node_config_get(void);
+
+/**
+ * \brief Boots of the node, modulo NODE_CONFIG_BOOT_MASK + 1
+ *
+ * Counted in node_config_init(). Without CFS a random value instead,
+ * which still differs from the previous boot most of the time.
+ */
+uint8_t node_config_boot(void);
+
+/**
+ * \brief Check, apply and save new intervals
+ * \return 1 on success, 0 if a value is out of bounds
+ *
+ * The reporting interval cannot be shorter than the sampling interval.
+ */
+int node_config_set(const node_config_t *config);
+
+uint16_t node_config_sample_windows(void);
+
+uint16_t node_config_report_windows(void);
+
+/**
+ * \brief Time between two readings, as the scheduler runs them
+ *
+ * An interval shorter than WAKE_PERIOD is returned as it is: the sampling
+ * job then runs in every window and takes the readings in between on its
+ * own timer, which only nodes with a NODE_CONFIG_CONF_SAMPLE_MIN below
+ * the window do.
+ */
+clock_time_t node_config_sample_time(void);
+
+#endif /* NODE_CONFIG_H_ */
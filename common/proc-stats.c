@@ -0,0 +1,151 @@
+/**
+ * \file
+ *      CPU time and invocations of each Contiki process on a node.
+ */
+
+#include "proc-stats.h"
+#include "sys/rtimer.h"
+#include "shell.h"
+#include "shell-commands.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static proc_stats_t table[PROC_STATS_MAX];
+static uint8_t count;
+/*---------------------------------------------------------------------------*/
+/* Every attached process runs through here, the pt gives the process */
+static
+PT_THREAD(profiled_thread(struct pt *pt, process_event_t ev, process_data_t data))
+{
+  struct process *p = (struct process *)((char *)pt - offsetof(struct process, pt));
+  proc_stats_t *s;
+  rtimer_clock_t start;
+  uint32_t ticks;
+  char ret;
+
+  for(s = table; s->process != p; s++);
+
+  start = RTIMER_NOW();
+  ret = s->thread(pt, ev, data);
+  ticks = (uint32_t)(RTIMER_NOW() - start);
+
+  s->ticks += ticks;
+  s->calls++;
+  if(ticks > s->max_ticks) {
+    s->max_ticks = ticks;
+  }
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+to_ms(uint32_t ticks)
+{
+  return (unsigned long)((uint64_t)ticks * 1000 / RTIMER_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+static
+PT_THREAD(cmd_procstats(struct pt *pt, shell_output_func output, char *args))
+{
+  char ms[PROC_STATS_U64_LEN];
+  uint8_t i;
+
+  PT_BEGIN(pt);
+
+  if(args != NULL && strcmp(args, "reset") == 0) {
+    proc_stats_reset();
+    SHELL_OUTPUT(output, "Process counters cleared\n");
+    PT_EXIT(pt);
+  }
+
+  SHELL_OUTPUT(output, "Process                    calls      ms  max ms\n");
+  for(i = 0; i < count; i++) {
+    SHELL_OUTPUT(output, "%-24.24s %8lu %7s %7lu\n",
+                 PROCESS_NAME_STRING(table[i].process),
+                 (unsigned long)table[i].calls,
+                 proc_stats_u64(table[i].ticks * 1000 / RTIMER_SECOND, ms),
+                 to_ms(table[i].max_ticks));
+  }
+
+  PT_END(pt);
+}
+/*---------------------------------------------------------------------------*/
+static const struct shell_command_t commands[] = {
+  { "procstats", cmd_procstats, "'> procstats [reset]': CPU time and calls of each process" },
+  { NULL, NULL, NULL },
+};
+
+static struct shell_command_set_t command_set = {
+  .next = NULL,
+  .commands = commands,
+};
+/*---------------------------------------------------------------------------*/
+int
+proc_stats_attach(struct process *p)
+{
+  uint8_t i;
+
+  for(i = 0; i < count; i++) {
+    if(table[i].process == p) {
+      return 1;
+    }
+  }
+  if(count == PROC_STATS_MAX) {
+    return 0;
+  }
+  if(count == 0) {
+    shell_command_set_register(&command_set);
+  }
+
+  memset(&table[count], 0, sizeof(table[count]));
+  table[count].process = p;
+  table[count].thread = p->thread;
+  count++;
+  p->thread = profiled_thread;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+proc_stats_count(void)
+{
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+const proc_stats_t *
+proc_stats_get(uint8_t i)
+{
+  return i < count ? &table[i] : NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+proc_stats_reset(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < count; i++) {
+    table[i].ticks = 0;
+    table[i].calls = 0;
+    table[i].max_ticks = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+char *
+proc_stats_u64(uint64_t value, char *buf)
+{
+  char digits[PROC_STATS_U64_LEN];
+  uint8_t n = 0;
+  uint8_t i;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while(value > 0);
+
+  for(i = 0; i < n; i++) {
+    buf[i] = digits[n - 1 - i];
+  }
+  buf[n] = '\0';
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
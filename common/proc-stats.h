@@ -0,0 +1,67 @@
+/**
+ * \file
+ *      CPU time and invocations of each Contiki process on a node.
+ *
+ *      proc_stats_attach() puts a wrapper in front of the thread of a
+ *      process. Every time the kernel dispatches an event or a poll to
+ *      it, the wrapper counts the call and the rtimer ticks spent in it.
+ *      The cost is two RTIMER_NOW() reads and a short table walk per
+ *      dispatch, nothing for processes that are not attached.
+ *
+ *      The time is inclusive: a process_post_synch() to another attached
+ *      process is counted for both, and so are interrupts taken while the
+ *      thread runs.
+ *
+ *      The table is readable with the "procstats" shell command, and over
+ *      CoAP on the sensor nodes (res-proc-stats.c).
+ */
+
+#ifndef PROC_STATS_H_
+#define PROC_STATS_H_
+
+#include "contiki.h"
+
+#ifdef PROC_STATS_CONF_MAX
+#define PROC_STATS_MAX            PROC_STATS_CONF_MAX
+#else
+#define PROC_STATS_MAX            8
+#endif
+
+typedef struct proc_stats {
+  struct process *process;
+  /* The thread the wrapper calls */
+  PT_THREAD((*thread)(struct pt *, process_event_t, process_data_t));
+  uint64_t ticks;             /* RTIMER_SECOND ticks spent in the thread */
+  uint32_t calls;
+  uint32_t max_ticks;         /* Longest single call */
+} proc_stats_t;
+
+/**
+ * \brief Start accounting a process, started or not
+ * \return 1 on success, 0 if the table is full
+ */
+int proc_stats_attach(struct process *p);
+
+/** \brief Number of attached processes */
+uint8_t proc_stats_count(void);
+
+/** \brief Accounting of the i-th attached process, NULL past the end */
+const proc_stats_t *proc_stats_get(uint8_t i);
+
+/** \brief Zero the counters, the processes stay attached */
+void proc_stats_reset(void);
+
+/* Room for the digits of a uint64_t and the terminator */
+#define PROC_STATS_U64_LEN        21
+
+/**
+ * \brief Write a 64-bit counter in decimal
+ * \param buf At least PROC_STATS_U64_LEN bytes
+ * \return buf
+ *
+ * The printf of the CC13xx/CC26xx toolchain has no 64-bit conversion, and
+ * a cast to unsigned long would wrap the tick count after about 18 h.
+ */
+char *proc_stats_u64(uint64_t value, char *buf);
+
+#endif /* PROC_STATS_H_ */
@@ -0,0 +1,95 @@
+/**
+ * \file
+ *      Send-on-delta reporting policy for the sensor nodes.
+ */
+
+#include "report-policy.h"
+
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------*/
+static void
+holdoff_expired(void *ptr)
+{
+  report_policy_t *p = ptr;
+
+  if(p->changed) {
+    process_poll(p->reporter);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+report_policy_init(report_policy_t *p, report_channel_t *channels,
+                   uint8_t count, struct process *reporter)
+{
+  uint8_t i;
+
+  p->reporter = reporter;
+  p->channels = channels;
+  p->count = count;
+  p->changed = 0;
+  p->change_reports = 0;
+  p->heartbeat_reports = 0;
+  p->last_report = clock_time() - REPORT_POLICY_MIN_INTERVAL;
+
+  for(i = 0; i < count; i++) {
+    channels[i].valid = 0;
+    channels[i].sent = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+report_policy_sample(report_policy_t *p, uint8_t channel, int32_t value)
+{
+  report_channel_t *ch;
+  clock_time_t since;
+
+  if(channel >= p->count) {
+    return 0;
+  }
+
+  ch = &p->channels[channel];
+  ch->value = value;
+  ch->valid = 1;
+
+  if(ch->sent && labs((long)value - ch->reported) < ch->delta) {
+    return 0;
+  }
+  if(p->changed) {
+    /* Already on its way */
+    return 1;
+  }
+  p->changed = 1;
+
+  since = clock_time() - p->last_report;
+  if(since >= REPORT_POLICY_MIN_INTERVAL) {
+    process_poll(p->reporter);
+  } else {
+    ctimer_set(&p->holdoff, REPORT_POLICY_MIN_INTERVAL - since,
+               holdoff_expired, p);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+report_policy_reported(report_policy_t *p)
+{
+  uint8_t i;
+
+  if(p->changed) {
+    p->change_reports++;
+  } else {
+    p->heartbeat_reports++;
+  }
+  p->changed = 0;
+  p->last_report = clock_time();
+  ctimer_stop(&p->holdoff);
+
+  for(i = 0; i < p->count; i++) {
+    if(p->channels[i].valid) {
+      p->channels[i].reported = p->channels[i].value;
+      p->channels[i].sent = 1;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
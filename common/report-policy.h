@@ -0,0 +1,81 @@
+/**
+ * \file
+ *      Send-on-delta reporting policy for the sensor nodes.
+ *
+ *      The sampling process hands every new sample to the policy. A
+ *      sample that moved by at least the delta of its channel since the
+ *      last report polls the reporting process right away, other samples
+ *      wait for the heartbeat. Change reports are spaced at least
+ *      REPORT_POLICY_MIN_INTERVAL apart so a noisy channel cannot flood
+ *      the network: a change inside that time arms the holdoff ctimer,
+ *      which polls the reporter when it runs out.
+ *
+ *      The heartbeat is the reporting job of the wake scheduler (wake.h),
+ *      every REPORT_POLICY_HEARTBEAT by default, so it shares the radio
+ *      wake-up window with the other jobs. The reporting process waits
+ *      for wake_event or PROCESS_EVENT_POLL, sends every channel and then
+ *      calls report_policy_reported().
+ */
+
+#ifndef REPORT_POLICY_H_
+#define REPORT_POLICY_H_
+
+#include "contiki.h"
+
+/* Default interval of the reporting job, the longest time between two
+   reports, changed or not */
+#ifdef REPORT_POLICY_CONF_HEARTBEAT
+#define REPORT_POLICY_HEARTBEAT   REPORT_POLICY_CONF_HEARTBEAT
+#else
+#define REPORT_POLICY_HEARTBEAT   (30 * 60 * CLOCK_SECOND)
+#endif
+
+/* Shortest time between two reports triggered by a change */
+#ifdef REPORT_POLICY_CONF_MIN_INTERVAL
+#define REPORT_POLICY_MIN_INTERVAL REPORT_POLICY_CONF_MIN_INTERVAL
+#else
+#define REPORT_POLICY_MIN_INTERVAL (10 * CLOCK_SECOND)
+#endif
+
+typedef struct report_channel {
+  int32_t delta;              /* Smallest change reported at once */
+  int32_t value;              /* Latest sample */
+  int32_t reported;           /* Value in the last report */
+  uint8_t valid;              /* A sample was taken */
+  uint8_t sent;               /* reported holds a value */
+} report_channel_t;
+
+/* Static initializer for a channel */
+#define REPORT_CHANNEL(d)         { (d), 0, 0, 0, 0 }
+
+typedef struct report_policy {
+  struct ctimer holdoff;
+  struct process *reporter;
+  report_channel_t *channels;
+  clock_time_t last_report;
+  uint32_t change_reports;
+  uint32_t heartbeat_reports;
+  uint8_t count;
+  uint8_t changed;            /* A change report is due */
+} report_policy_t;
+
+/**
+ * \brief Set up a policy
+ * \param channels Channel table, each with its delta filled in
+ * \param reporter Process polled when a change report is due
+ */
+void report_policy_init(report_policy_t *p, report_channel_t *channels,
+                        uint8_t count, struct process *reporter);
+
+/**
+ * \brief Record a new sample of one channel
+ * \return 1 if the sample makes a change report due, 0 otherwise
+ *
+ * The first sample of a channel is always reported.
+ */
+int report_policy_sample(report_policy_t *p, uint8_t channel, int32_t value);
+
+/** \brief Tell the policy that a report with every channel went out */
+void report_policy_reported(report_policy_t *p);
+
+#endif /* REPORT_POLICY_H_ */
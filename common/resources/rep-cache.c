@@ -0,0 +1,176 @@
+/**
+ * \file
+ *      Cached CoAP representations of a sensor reading.
+ */
+
+#include "rep-cache.h"
+#include "random.h"
+
+#include <string.h>
+
+#include "sys/log.h"
+#define LOG_MODULE "RepCache"
+#ifdef LOG_CONF_LEVEL_FARM
+#define LOG_LEVEL LOG_CONF_LEVEL_FARM
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+static const unsigned int formats[REP_CACHE_FORMATS] = {
+  TEXT_PLAIN, APPLICATION_XML, APPLICATION_JSON,
+  REP_CACHE_CBOR, REP_CACHE_SENML_CBOR
+};
+
+/* Shared by all caches so that no two values get the same ETag */
+static uint32_t next_version;
+/*---------------------------------------------------------------------------*/
+static int
+format_index(unsigned int format)
+{
+  int i;
+
+  for(i = 0; i < REP_CACHE_FORMATS; i++) {
+    if(formats[i] == format) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+encode_all(rep_cache_t *c)
+{
+  uint16_t off = 0;
+  int n;
+  int i;
+
+  for(i = 0; i < REP_CACHE_FORMATS; i++) {
+    n = c->encode(&c->buf[off], c->size - off, formats[i], c->ptr);
+    if(n < 0 || n >= c->size - off || n > UINT8_MAX) {
+      LOG_ERR("Representation %u does not fit\n", formats[i]);
+      return 0;
+    }
+    c->len[i] = (uint8_t)n;
+    off += n;
+  }
+  c->encoded = 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+rep_cache_init(rep_cache_t *c, char *buf, uint16_t size,
+               rep_cache_encoder_t encode, const void *ptr)
+{
+  memset(c, 0, sizeof(*c));
+  c->buf = buf;
+  c->size = size;
+  c->encode = encode;
+  c->ptr = ptr;
+
+  /* A client keeping ETags across our reboot should not match by chance */
+  if(next_version == 0) {
+    next_version = ((uint32_t)random_rand() << 16) | random_rand();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rep_cache_update(rep_cache_t *c, clock_time_t max_age)
+{
+  /* Each format adds its index to the version for its own ETag */
+  next_version += REP_CACHE_FORMATS;
+  c->version = next_version;
+  c->expires = clock_time() + max_age;
+  c->encoded = 0;
+  c->valid = 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+rep_cache_invalidate(rep_cache_t *c)
+{
+  c->valid = 0;
+  c->encoded = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+rep_cache_block(coap_message_t *response, const void *data, uint16_t len,
+                uint16_t preferred_size, int32_t *offset)
+{
+  uint16_t n;
+
+  if(*offset > 0 && *offset >= len) {
+    coap_set_status_code(response, BAD_OPTION_4_02);
+    /* A block error message should not exceed the minimum block size (16) */
+    coap_set_payload(response, "BlockOutOfScope", 15);
+    return;
+  }
+
+  n = len - *offset;
+  if(n > preferred_size) {
+    n = preferred_size;
+  }
+  coap_set_payload(response, (const uint8_t *)data + *offset, n);
+
+  *offset += n;
+  if(*offset >= len) {
+    *offset = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rep_cache_serve(rep_cache_t *c, coap_message_t *request,
+                coap_message_t *response, uint16_t preferred_size,
+                int32_t *offset)
+{
+  unsigned int accept = -1;
+  const uint8_t *etag;
+  uint8_t tag[REP_CACHE_ETAG_LEN];
+  uint32_t version;
+  clock_time_t now;
+  uint16_t off = 0;
+  int f;
+  int i;
+
+  if(!c->valid) {
+    coap_set_status_code(response, NOT_FOUND_4_04);
+    return;
+  }
+
+  coap_get_header_accept(request, &accept);
+  f = format_index(accept == -1 ? TEXT_PLAIN : accept);
+  if(f < 0) {
+    coap_set_status_code(response, NOT_ACCEPTABLE_4_06);
+    /* Kept within one block, an error is never sent block-wise */
+    const char *msg = "Accept: 0, 41, 50, 60 or 112";
+    coap_set_payload(response, msg, strlen(msg));
+    return;
+  }
+
+  if(!c->encoded && !encode_all(c)) {
+    coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+    return;
+  }
+
+  version = c->version + f;
+  for(i = 0; i < REP_CACHE_ETAG_LEN; i++) {
+    tag[i] = (uint8_t)(version >> (8 * (REP_CACHE_ETAG_LEN - 1 - i)));
+  }
+  coap_set_header_etag(response, tag, sizeof(tag));
+
+  now = clock_time();
+  coap_set_header_max_age(response, CLOCK_LT(now, c->expires)
+                          ? (c->expires - now) / CLOCK_SECOND : 0);
+
+  /* The client already has this representation */
+  if(coap_get_header_etag(request, &etag) == sizeof(tag)
+     && memcmp(etag, tag, sizeof(tag)) == 0) {
+    coap_set_status_code(response, VALID_2_03);
+    return;
+  }
+
+  for(i = 0; i < f; i++) {
+    off += c->len[i];
+  }
+  coap_set_header_content_format(response, formats[f]);
+  rep_cache_block(response, &c->buf[off], c->len[f], preferred_size, offset);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,98 @@
+/**
+ * \file
+ *      Cached CoAP representations of a sensor reading.
+ *
+ *      The sampling process calls rep_cache_update() when it has a new
+ *      value. The first GET after that encodes every supported content
+ *      format once into the cache, and later GETs are served from it until
+ *      the next sample. Responses carry an ETag, different for each value
+ *      and format, and a Max-Age equal to the time left until the next
+ *      sample. A GET with the current ETag gets a 2.03 Valid and no payload.
+ */
+
+#ifndef REP_CACHE_H_
+#define REP_CACHE_H_
+
+#include "contiki.h"
+#include "coap-engine.h"
+
+#include <stdlib.h>
+
+/* CoAP content formats the engine has no name for */
+#define REP_CACHE_CBOR            60    /* application/cbor */
+#define REP_CACHE_SENML_CBOR      112   /* application/senml+cbor */
+
+/* text/plain, XML, JSON, CBOR and SenML-CBOR */
+#define REP_CACHE_FORMATS         5
+
+#define REP_CACHE_ETAG_LEN        4
+
+/*
+ * printf() arguments of a fixed-point value with two or three decimals,
+ * for REP_FIXED2_FMT and REP_FIXED3_FMT. The value is evaluated more than
+ * once.
+ */
+#define REP_FIXED2_FMT            "%s%ld.%02ld"
+#define REP_FIXED2(v)             ((v) < 0 ? "-" : ""), labs((long)(v)) / 100, \
+                                  labs((long)(v)) % 100
+#define REP_FIXED3_FMT            "%s%ld.%03ld"
+#define REP_FIXED3(v)             ((v) < 0 ? "-" : ""), labs((long)(v)) / 1000, \
+                                  labs((long)(v)) % 1000
+
+/**
+ * Encoder for one content format, with snprintf() semantics. The binary
+ * formats return -1 when they do not fit.
+ * \return Length of the representation, as snprintf() would
+ */
+typedef int (*rep_cache_encoder_t)(char *buf, uint16_t size,
+                                   unsigned int format, const void *ptr);
+
+typedef struct rep_cache {
+  rep_cache_encoder_t encode;
+  const void *ptr;            /* Handed to the encoder */
+  char *buf;                  /* Representations, one after the other */
+  clock_time_t expires;       /* Next sample due */
+  uint32_t version;           /* New for every value, base of the ETags */
+  uint16_t size;
+  uint8_t len[REP_CACHE_FORMATS];
+  uint8_t encoded;            /* buf holds this version */
+  uint8_t valid;              /* There is a value to serve */
+} rep_cache_t;
+
+/**
+ * \brief Set up an empty cache
+ * \param buf  Room for all formats of one value, without terminators
+ * \param ptr  Passed to encode, usually the value itself
+ */
+void rep_cache_init(rep_cache_t *c, char *buf, uint16_t size,
+                    rep_cache_encoder_t encode, const void *ptr);
+
+/**
+ * \brief A new value was sampled
+ * \param max_age Time until the next sample
+ */
+void rep_cache_update(rep_cache_t *c, clock_time_t max_age);
+
+/** \brief The value is gone, GETs get 4.04 until the next update */
+void rep_cache_invalidate(rep_cache_t *c);
+
+/**
+ * \brief Answer a GET from the cache
+ *
+ * Takes preferred_size and offset from the resource handler and sends the
+ * representation block-wise when it does not fit one block.
+ */
+void rep_cache_serve(rep_cache_t *c, coap_message_t *request,
+                     coap_message_t *response, uint16_t preferred_size,
+                     int32_t *offset);
+
+/**
+ * \brief Send the slice of data at *offset, at most preferred_size long
+ *
+ * For chunk-aware resource handlers: moves *offset on, to -1 after the
+ * last block. An offset past the end is answered with 4.02.
+ */
+void rep_cache_block(coap_message_t *response, const void *data,
+                     uint16_t len, uint16_t preferred_size, int32_t *offset);
+
+#endif /* REP_CACHE_H_ */
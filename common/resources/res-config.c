@@ -0,0 +1,96 @@
+/**
+ * \file
+ *      /config resource: sampling and reporting intervals of the node.
+ *
+ *      GET answers "sample=<s>&report=<s>". PUT takes the same variables,
+ *      either or both, and answers 2.04 Changed, or 4.00 Bad Request when
+ *      a value is not a number or out of the node_config bounds.
+ */
+
+#include "coap-engine.h"
+#include "node-config.h"
+
+#include <stdio.h>
+
+static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+RESOURCE(res_config,
+         "title=\"Node config: PUT sample=s&report=s\";rt=\"config\"",
+         res_get_handler,
+         NULL,
+         res_put_handler,
+         NULL);
+
+/* parse_seconds() results that are not a number of seconds */
+#define SECONDS_ABSENT            -1
+#define SECONDS_INVALID           -2
+/*---------------------------------------------------------------------------*/
+/*
+ * Seconds from a variable, which is not terminated. SECONDS_ABSENT if the
+ * variable is missing, SECONDS_INVALID if it is empty or not a number.
+ */
+static long
+parse_seconds(coap_message_t *request, const char *name)
+{
+  const char *value = NULL;
+  size_t len;
+  size_t i;
+  long seconds = 0;
+
+  len = coap_get_post_variable(request, name, &value);
+  if(value == NULL) {
+    return SECONDS_ABSENT;
+  }
+  if(len == 0 || len > 6) {
+    return SECONDS_INVALID;
+  }
+  for(i = 0; i < len; i++) {
+    if(value[i] < '0' || value[i] > '9') {
+      return SECONDS_INVALID;
+    }
+    seconds = seconds * 10 + (value[i] - '0');
+  }
+  return seconds;
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  const node_config_t *c = node_config_get();
+  int len;
+
+  len = snprintf((char *)buffer, preferred_size, "sample=%lu&report=%lu",
+                 (unsigned long)c->sample_interval,
+                 (unsigned long)c->report_interval);
+  coap_set_header_content_format(response, TEXT_PLAIN);
+  coap_set_payload(response, buffer, MIN(len, preferred_size));
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_put_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  node_config_t c = *node_config_get();
+  long sample = parse_seconds(request, "sample");
+  long report = parse_seconds(request, "report");
+
+  if(sample == SECONDS_INVALID || report == SECONDS_INVALID ||
+     (sample == SECONDS_ABSENT && report == SECONDS_ABSENT)) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+    return;
+  }
+  if(sample != SECONDS_ABSENT) {
+    c.sample_interval = sample;
+  }
+  if(report != SECONDS_ABSENT) {
+    c.report_interval = report;
+  }
+
+  /* Bounds are checked there, 0 included, nothing changes on a bad value */
+  if(!node_config_set(&c)) {
+    coap_set_status_code(response, BAD_REQUEST_4_00);
+    return;
+  }
+  coap_set_status_code(response, CHANGED_2_04);
+}
+/*---------------------------------------------------------------------------*/
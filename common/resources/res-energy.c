@@ -0,0 +1,56 @@
+/**
+ * \file
+ *      /energy resource: energest time of the last report period.
+ *
+ *      JSON with the period and the time in each CPU and radio state, in
+ *      1/1024 s, sent block-wise. Observers are notified when a period
+ *      closes.
+ */
+
+#include "coap-engine.h"
+#include "energy.h"
+#include "rep-cache.h"
+
+#include <stdio.h>
+
+static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_event_handler(void);
+
+EVENT_RESOURCE(res_energy,
+               "title=\"Energest of the last period (1/1024 s)\";rt=\"energy\";obs",
+               res_get_handler,
+               NULL,
+               NULL,
+               NULL,
+               res_event_handler);
+
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  static char json[128];
+  const energy_t *e = energy_last();
+  int len;
+
+  len = snprintf(json, sizeof(json),
+                 "{\"period\":%lu,\"cpu\":%lu,\"lpm\":%lu,\"deep_lpm\":%lu,"
+                 "\"listen\":%lu,\"transmit\":%lu}",
+                 (unsigned long)e->period, (unsigned long)e->cpu,
+                 (unsigned long)e->lpm, (unsigned long)e->deep_lpm,
+                 (unsigned long)e->listen, (unsigned long)e->transmit);
+  if(len < 0 || len >= sizeof(json)) {
+    coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+    return;
+  }
+  coap_set_header_content_format(response, APPLICATION_JSON);
+  /* Longer than one chunk, sent block-wise */
+  rep_cache_block(response, json, len, preferred_size, offset);
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the period just closed to every observer */
+static void
+res_event_handler(void)
+{
+  coap_notify_observers(&res_energy);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,109 @@
+/**
+ * \file
+ *      /procstats resource: CPU time and invocations of each process.
+ *
+ *      JSON array with one object per attached process: its name, the
+ *      number of calls, and the total and longest call time in rtimer
+ *      ticks (RTIMER_SECOND per second), sent block-wise. A POST clears
+ *      the counters.
+ */
+
+#include "coap-engine.h"
+#include "proc-stats.h"
+#include "sys/rtimer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+RESOURCE(res_proc_stats,
+         "title=\"Process CPU ticks and calls, POST to clear\";rt=\"procstats\"",
+         res_get_handler,
+         res_post_handler,
+         NULL,
+         NULL);
+
+/*---------------------------------------------------------------------------*/
+/* The part of the whole JSON that goes out in this block */
+typedef struct window {
+  uint8_t *buf;
+  uint16_t size;
+  uint16_t len;
+  int32_t offset;             /* Of buf in the whole JSON */
+  int32_t pos;                /* Bytes of the whole JSON generated so far */
+} window_t;
+
+static void
+window_put(window_t *w, const char *s, int n)
+{
+  int32_t skip = w->offset - w->pos;
+  int32_t copy;
+
+  if(skip < 0) {
+    skip = 0;
+  }
+  if(skip < n && w->len < w->size) {
+    copy = n - skip;
+    if(copy > w->size - w->len) {
+      copy = w->size - w->len;
+    }
+    memcpy(&w->buf[w->len], &s[skip], copy);
+    w->len += copy;
+  }
+  w->pos += n;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The JSON is generated again for every block and only the bytes at
+ * *offset are kept, one process at a time.
+ */
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  char item[112];
+  char ticks[PROC_STATS_U64_LEN];
+  const proc_stats_t *s;
+  window_t w = { buffer, preferred_size, 0, *offset, 0 };
+  int n;
+  uint8_t i;
+
+  window_put(&w, "[", 1);
+  for(i = 0; (s = proc_stats_get(i)) != NULL; i++) {
+    n = snprintf(item, sizeof(item),
+                 "%s{\"name\":\"%.24s\",\"calls\":%lu,\"ticks\":%s,\"max\":%lu}",
+                 i > 0 ? "," : "", PROCESS_NAME_STRING(s->process),
+                 (unsigned long)s->calls, proc_stats_u64(s->ticks, ticks),
+                 (unsigned long)s->max_ticks);
+    if(n < 0 || n >= sizeof(item)) {
+      coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+      return;
+    }
+    window_put(&w, item, n);
+  }
+  window_put(&w, "]", 1);
+
+  if(*offset > 0 && *offset >= w.pos) {
+    coap_set_status_code(response, BAD_OPTION_4_02);
+    /* A block error message should not exceed the minimum block size (16) */
+    coap_set_payload(response, "BlockOutOfScope", 15);
+    return;
+  }
+
+  coap_set_header_content_format(response, APPLICATION_JSON);
+  coap_set_payload(response, buffer, w.len);
+
+  *offset += w.len;
+  if(*offset >= w.pos) {
+    *offset = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_post_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  proc_stats_reset();
+  coap_set_status_code(response, CHANGED_2_04);
+}
+/*---------------------------------------------------------------------------*/
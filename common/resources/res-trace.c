@@ -0,0 +1,48 @@
+/**
+ * \file
+ *      /trace resource: the trace ring as raw entries, oldest first.
+ *
+ *      application/octet-stream of trace_entry_t records (trace.h), sent
+ *      block-wise. Entries recorded between two blocks shift the ring, so
+ *      a dump taken while the node is busy can repeat or skip one.
+ */
+
+#include "coap-engine.h"
+#include "trace.h"
+
+#if TRACE_ON
+
+static void res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+RESOURCE(res_trace,
+         "title=\"Trace ring, 12-byte entries\";rt=\"trace\";ct=42",
+         res_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+/*---------------------------------------------------------------------------*/
+static void
+res_get_handler(coap_message_t *request, coap_message_t *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  uint32_t end = (uint32_t)trace_len() * sizeof(trace_entry_t);
+  uint16_t len;
+
+  if(*offset > 0 && *offset >= end) {
+    coap_set_status_code(response, BAD_OPTION_4_02);
+    /* A block error message should not exceed the minimum block size (16) */
+    coap_set_payload(response, "BlockOutOfScope", 15);
+    return;
+  }
+
+  len = trace_read(*offset, buffer, preferred_size);
+  coap_set_header_content_format(response, APPLICATION_OCTET_STREAM);
+  coap_set_payload(response, buffer, len);
+
+  *offset += len;
+  if(*offset >= end) {
+    *offset = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* TRACE_ON */
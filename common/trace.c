@@ -0,0 +1,124 @@
+/**
+ * \file
+ *      Binary trace ring of a node.
+ */
+
+#include "trace.h"
+
+#if TRACE_ON
+
+#include "shell.h"
+#include "shell-commands.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static trace_entry_t ring[TRACE_SIZE];
+static uint32_t total;
+
+/* Only read by the shell, the ring itself holds numbers */
+static const char *const names[TRACE_EVENTS] = {
+  "?", "boot", "sample-error", "report", "held", "batch", "wake-late",
+  "config", "ezo-status",
+};
+/*---------------------------------------------------------------------------*/
+/* The i-th entry, oldest first */
+static const trace_entry_t *
+entry(uint16_t i)
+{
+  if(total <= TRACE_SIZE) {
+    return &ring[i];
+  }
+  return &ring[(total + i) % TRACE_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static
+PT_THREAD(cmd_trace(struct pt *pt, shell_output_func output, char *args))
+{
+  const trace_entry_t *e;
+  uint16_t i;
+
+  PT_BEGIN(pt);
+
+  if(args != NULL && strcmp(args, "clear") == 0) {
+    total = 0;
+    SHELL_OUTPUT(output, "Trace cleared\n");
+    PT_EXIT(pt);
+  }
+
+  SHELL_OUTPUT(output, "%u of %lu events, %u ticks per second\n",
+               trace_len(), (unsigned long)total, (unsigned)CLOCK_SECOND);
+  for(i = 0; i < trace_len(); i++) {
+    e = entry(i);
+    SHELL_OUTPUT(output, "%10lu %-12s %5u %ld\n", (unsigned long)e->time,
+                 names[e->id < TRACE_EVENTS ? e->id : 0], e->a, (long)e->b);
+  }
+
+  PT_END(pt);
+}
+/*---------------------------------------------------------------------------*/
+static const struct shell_command_t commands[] = {
+  { "trace", cmd_trace, "'> trace [clear]': Events of the trace ring, oldest first" },
+  { NULL, NULL, NULL },
+};
+
+static struct shell_command_set_t command_set = {
+  .next = NULL,
+  .commands = commands,
+};
+/*---------------------------------------------------------------------------*/
+void
+trace_init(void)
+{
+  total = 0;
+  shell_command_set_register(&command_set);
+  trace_put(TRACE_BOOT, 0, 0);
+}
+/*---------------------------------------------------------------------------*/
+void
+trace_put(uint16_t id, uint16_t a, int32_t b)
+{
+  trace_entry_t *e = &ring[total % TRACE_SIZE];
+
+  e->time = (uint32_t)clock_time();
+  e->id = id;
+  e->a = a;
+  e->b = b;
+  total++;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+trace_len(void)
+{
+  return total < TRACE_SIZE ? total : TRACE_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+trace_total(void)
+{
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+trace_read(uint32_t offset, uint8_t *buf, uint16_t len)
+{
+  uint32_t end = (uint32_t)trace_len() * sizeof(trace_entry_t);
+  uint16_t copied = 0;
+  uint16_t skip;
+  uint16_t n;
+
+  while(copied < len && offset < end) {
+    skip = offset % sizeof(trace_entry_t);
+    n = sizeof(trace_entry_t) - skip;
+    if(n > len - copied) {
+      n = len - copied;
+    }
+    memcpy(&buf[copied],
+           (const uint8_t *)entry(offset / sizeof(trace_entry_t)) + skip, n);
+    copied += n;
+    offset += n;
+  }
+  return copied;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* TRACE_ON */
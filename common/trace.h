@@ -0,0 +1,84 @@
+/**
+ * \file
+ *      Binary trace ring of a node.
+ *
+ *      TRACE(id, a, b) keeps the event, the clock time and two arguments
+ *      in a fixed ring of TRACE_SIZE entries, overwriting the oldest.
+ *      Nothing is formatted on the node: the ring is printed on demand by
+ *      the "trace" shell command and served as raw entries at /trace on
+ *      the sensor nodes. With TRACE_ON at 0 every call compiles out.
+ *
+ *      Not for interrupt context, the ring is not locked.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "contiki.h"
+
+#ifdef TRACE_CONF_ON
+#define TRACE_ON                  TRACE_CONF_ON
+#else
+#define TRACE_ON                  0
+#endif
+
+/* Entries, 12 bytes each */
+#ifdef TRACE_CONF_SIZE
+#define TRACE_SIZE                TRACE_CONF_SIZE
+#else
+#define TRACE_SIZE                32
+#endif
+
+/* Events, with what a and b hold */
+#define TRACE_BOOT                1   /* -, - */
+#define TRACE_SAMPLE_ERROR        2   /* channel, detail or 0 */
+#define TRACE_REPORT              3   /* seq, frame length */
+#define TRACE_HELD                4   /* seq, frames held */
+#define TRACE_BATCH               5   /* frames left, batch length */
+#define TRACE_WAKE_LATE           6   /* sampling jobs late, - */
+#define TRACE_CONFIG              7   /* sample s, report s */
+#define TRACE_EZO_STATUS          8   /* I2C address, status */
+#define TRACE_EVENTS              9
+
+/*
+ * One entry as kept and as served at /trace, in the node's (little)
+ * byte order.
+ */
+typedef struct trace_entry {
+  uint32_t time;              /* clock_time() */
+  uint16_t id;
+  uint16_t a;
+  int32_t b;
+} trace_entry_t;
+
+#if TRACE_ON
+
+/** \brief Clear the ring, register the shell command, record TRACE_BOOT */
+void trace_init(void);
+
+/** \brief Record an event, see TRACE() */
+void trace_put(uint16_t id, uint16_t a, int32_t b);
+
+/** \brief Entries in the ring, at most TRACE_SIZE */
+uint16_t trace_len(void);
+
+/** \brief Events recorded since trace_init(), overwritten ones included */
+uint32_t trace_total(void);
+
+/**
+ * \brief Copy the ring as bytes, oldest entry first
+ * \param offset Byte offset into trace_len() * sizeof(trace_entry_t)
+ * \return Bytes copied, 0 past the end
+ */
+uint16_t trace_read(uint32_t offset, uint8_t *buf, uint16_t len);
+
+#define TRACE(id, a, b)           trace_put((id), (uint16_t)(a), (int32_t)(b))
+
+#else /* TRACE_ON */
+
+#define trace_init()
+#define TRACE(id, a, b)
+
+#endif /* TRACE_ON */
+
+#endif /* TRACE_H_ */
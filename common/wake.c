@@ -0,0 +1,179 @@
+/**
+ * \file
+ *      Coordinated wake-ups for the sensor nodes.
+ */
+
+#include "wake.h"
+#include "lib/list.h"
+#include "net/linkaddr.h"
+#include "trace.h"
+#if MAC_CONF_WITH_TSCH
+#include "net/mac/tsch/tsch.h"
+#endif
+
+#include "sys/log.h"
+#define LOG_MODULE "Wake"
+#ifdef LOG_CONF_LEVEL_FARM
+#define LOG_LEVEL LOG_CONF_LEVEL_FARM
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+process_event_t wake_event;
+
+LIST(jobs);
+static uint8_t busy;          /* Sampling jobs not done with this window */
+static uint32_t windows;
+static clock_time_t offset;   /* This node's place in the jitter */
+
+PROCESS(wake_process, "Wake-up scheduler");
+/*---------------------------------------------------------------------------*/
+static void
+add(wake_job_t *job, struct process *p, uint16_t every, uint8_t report)
+{
+  uint8_t i;
+  uint32_t hash = 0;
+
+  if(!process_is_running(&wake_process)) {
+    wake_event = process_alloc_event();
+    for(i = 0; i < LINKADDR_SIZE; i++) {
+      hash = hash * 31 + linkaddr_node_addr.u8[i];
+    }
+    offset = hash % (WAKE_JITTER + 1);
+    process_start(&wake_process, NULL);
+  }
+
+  job->process = p;
+  job->every = every > 0 ? every : 1;
+  job->countdown = job->every;
+  job->report = report;
+  job->busy = 0;
+  list_add(jobs, job);
+}
+/*---------------------------------------------------------------------------*/
+void
+wake_add_sampler(wake_job_t *job, struct process *p, uint16_t every)
+{
+  add(job, p, every, 0);
+}
+/*---------------------------------------------------------------------------*/
+void
+wake_add_reporter(wake_job_t *job, struct process *p, uint16_t every)
+{
+  add(job, p, every, 1);
+}
+/*---------------------------------------------------------------------------*/
+void
+wake_done(wake_job_t *job)
+{
+  /* Also called after the first round at boot, outside of any window */
+  if(job->busy) {
+    job->busy = 0;
+    if(--busy == 0) {
+      process_poll(&wake_process);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+wake_set_every(wake_job_t *job, uint16_t every)
+{
+  job->every = every > 0 ? every : 1;
+  /* A shorter interval takes effect at once, a longer one after the run */
+  if(job->countdown > job->every) {
+    job->countdown = job->every;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+wake_restart(wake_job_t *job)
+{
+  job->countdown = job->every;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+wake_windows(void)
+{
+  return windows;
+}
+/*---------------------------------------------------------------------------*/
+static int
+due(wake_job_t *job)
+{
+  if(--job->countdown > 0) {
+    return 0;
+  }
+  job->countdown = job->every;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Time until this node's next window on the grid of the network */
+static clock_time_t
+until_next_window(void)
+{
+  uint64_t now = clock_time();
+  clock_time_t wait;
+
+#if MAC_CONF_WITH_TSCH
+  /* Shared by the whole network once associated */
+  if(tsch_get_network_uptime_ticks() != (uint64_t)-1) {
+    now = tsch_get_network_uptime_ticks();
+  }
+#endif
+
+  wait = WAKE_PERIOD - (clock_time_t)(now % WAKE_PERIOD) + offset;
+  if(wait > WAKE_PERIOD) {
+    wait -= WAKE_PERIOD;
+  }
+  /* The window just served, woken a little early */
+  if(wait < WAKE_PERIOD / 4) {
+    wait += WAKE_PERIOD;
+  }
+  return wait;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(wake_process, ev, data)
+{
+  static struct etimer window;
+  static struct etimer timeout;
+  wake_job_t *job;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    etimer_set(&window, until_next_window());
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&window));
+    windows++;
+
+    for(job = list_head(jobs); job != NULL; job = list_item_next(job)) {
+      if(!job->report && due(job)) {
+        job->busy = 1;
+        busy++;
+        process_post(job->process, wake_event, job);
+      }
+    }
+
+    if(busy > 0) {
+      etimer_set(&timeout, WAKE_SAMPLE_TIMEOUT);
+      PROCESS_WAIT_EVENT_UNTIL(busy == 0 || etimer_expired(&timeout));
+      etimer_stop(&timeout);
+      if(busy > 0) {
+        LOG_WARN("%u sampling jobs late, reporting without them\n", busy);
+        TRACE(TRACE_WAKE_LATE, busy, 0);
+        for(job = list_head(jobs); job != NULL; job = list_item_next(job)) {
+          job->busy = 0;
+        }
+        busy = 0;
+      }
+    }
+
+    for(job = list_head(jobs); job != NULL; job = list_item_next(job)) {
+      if(job->report && due(job)) {
+        process_post(job->process, wake_event, job);
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
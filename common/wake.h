@@ -0,0 +1,89 @@
+/**
+ * \file
+ *      Coordinated wake-ups for the sensor nodes.
+ *
+ *      Instead of every process keeping its own etimer, the node wakes up
+ *      once per WAKE_PERIOD. In that window the sampling jobs that are
+ *      due get wake_event first. Once all of them called wake_done(), or
+ *      WAKE_SAMPLE_TIMEOUT passed, the reporting jobs that are due get
+ *      wake_event too, so sampling, encoding and sending share a single
+ *      wake-up of the MCU and the radio.
+ *
+ *      With TSCH the windows follow the network time, so every node of
+ *      the network wakes on the same grid. Each node then starts its
+ *      window at a fixed offset of up to WAKE_JITTER, taken from its
+ *      link-layer address, so the reports do not all go out in the same
+ *      slotframe. Set WAKE_CONF_PERIOD and WAKE_CONF_JITTER the same way
+ *      on every node.
+ *
+ *      A job runs in every n-th window. The first window after boot is
+ *      not waited for: jobs run their first round right away.
+ */
+
+#ifndef WAKE_H_
+#define WAKE_H_
+
+#include "contiki.h"
+
+#ifdef WAKE_CONF_PERIOD
+#define WAKE_PERIOD               WAKE_CONF_PERIOD
+#else
+#define WAKE_PERIOD               (15 * CLOCK_SECOND)
+#endif
+
+/* Spread of the window starts over the network */
+#ifdef WAKE_CONF_JITTER
+#define WAKE_JITTER               WAKE_CONF_JITTER
+#else
+#define WAKE_JITTER               (5 * CLOCK_SECOND)
+#endif
+
+/* Longest wait for the sampling jobs before the reports go out anyway */
+#ifdef WAKE_CONF_SAMPLE_TIMEOUT
+#define WAKE_SAMPLE_TIMEOUT       WAKE_CONF_SAMPLE_TIMEOUT
+#else
+#define WAKE_SAMPLE_TIMEOUT       (5 * CLOCK_SECOND)
+#endif
+
+#if WAKE_JITTER >= WAKE_PERIOD
+#error "WAKE_JITTER must be shorter than WAKE_PERIOD"
+#endif
+
+/* Windows in an interval, at least one */
+#define WAKE_WINDOWS(interval) \
+  ((interval) > WAKE_PERIOD ? (uint16_t)((interval) / WAKE_PERIOD) : 1)
+
+typedef struct wake_job {
+  struct wake_job *next;
+  struct process *process;
+  uint16_t every;             /* Windows from one run to the next */
+  uint16_t countdown;         /* Windows left until the next run */
+  uint8_t report;             /* Runs after the sampling jobs */
+  uint8_t busy;               /* Sampling job not done with this window */
+} wake_job_t;
+
+/** Posted to a job's process when its window comes, the job is the data */
+extern process_event_t wake_event;
+
+/**
+ * \brief Add a sampling job, run every n-th window
+ * \param p Process that gets wake_event and calls wake_done()
+ */
+void wake_add_sampler(wake_job_t *job, struct process *p, uint16_t every);
+
+/** \brief Add a reporting job, run after the samplers of its window */
+void wake_add_reporter(wake_job_t *job, struct process *p, uint16_t every);
+
+/** \brief A sampling job has its readings for this window */
+void wake_done(wake_job_t *job);
+
+/** \brief Run a job every n-th window from now on, without a restart */
+void wake_set_every(wake_job_t *job, uint16_t every);
+
+/** \brief Start counting the windows of a job from now on */
+void wake_restart(wake_job_t *job);
+
+/** \brief Windows the node woke up for since boot */
+uint32_t wake_windows(void);
+
+#endif /* WAKE_H_ */
@@ -0,0 +1,19 @@
+/**
+ * \file
+ *      Host stand-in for contiki.h: only what the natively tested modules
+ *      use. The test program provides clock_time().
+ */
+
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef unsigned long clock_time_t;
+
+#define CLOCK_SECOND              128
+
+clock_time_t clock_time(void);
+
+#endif /* CONTIKI_H_ */
@@ -0,0 +1,60 @@
+/**
+ * \file
+ *      Host stand-in for lib/memb.h, the same layout as the Contiki pool:
+ *      a static array of blocks and one reference count byte per block.
+ */
+
+#ifndef MEMB_H_
+#define MEMB_H_
+
+#include <string.h>
+
+struct memb {
+  unsigned short size;
+  unsigned short num;
+  char *used;
+  void *mem;
+};
+
+#define MEMB(name, structure, num) \
+  static char name##_memb_count[num]; \
+  static structure name##_memb_mem[num]; \
+  static struct memb name = { sizeof(structure), num, \
+                              name##_memb_count, (void *)name##_memb_mem }
+
+static inline void
+memb_init(struct memb *m)
+{
+  memset(m->used, 0, m->num);
+  memset(m->mem, 0, (size_t)m->size * m->num);
+}
+
+static inline void *
+memb_alloc(struct memb *m)
+{
+  int i;
+
+  for(i = 0; i < m->num; i++) {
+    if(m->used[i] == 0) {
+      m->used[i]++;
+      return (char *)m->mem + (size_t)i * m->size;
+    }
+  }
+  return NULL;
+}
+
+static inline char
+memb_free(struct memb *m, void *ptr)
+{
+  int i = (int)(((char *)ptr - (char *)m->mem) / m->size);
+
+  if(i < 0 || i >= m->num) {
+    return -1;
+  }
+  if(m->used[i] > 0) {
+    m->used[i]--;
+  }
+  return m->used[i];
+}
+
+#endif /* MEMB_H_ */
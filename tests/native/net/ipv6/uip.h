@@ -0,0 +1,25 @@
+/**
+ * \file
+ *      Host stand-in for net/ipv6/uip.h: the IPv6 address type and the
+ *      macros that copy and compare it.
+ */
+
+#ifndef UIP_H_
+#define UIP_H_
+
+#include "contiki.h"
+
+#include <string.h>
+
+typedef union uip_ip6addr_t {
+  uint8_t u8[16];
+  uint16_t u16[8];
+} uip_ip6addr_t;
+
+typedef uip_ip6addr_t uip_ipaddr_t;
+
+#define uip_ipaddr_copy(dest, src)  (*(dest) = *(src))
+#define uip_ipaddr_cmp(a, b) \
+  (memcmp(a, b, sizeof(uip_ip6addr_t)) == 0)
+
+#endif /* UIP_H_ */
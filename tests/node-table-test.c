@@ -0,0 +1,517 @@
+/**
+ * \file
+ *      Native test and benchmark of the border router node table
+ *      (RPL Border Router/farm/node-table.c).
+ *
+ *      Checks lookup and insert with colliding addresses, removal from a
+ *      bucket chain, a full pool refusing new nodes without evicting known
+ *      ones, channel slot and channel pool exhaustion, the chains of
+ *      channels by type, the energy table and the sequence number
+ *      accounting.
+ *      Then times lookup and update at several fill levels and prints the
+ *      RAM a node costs. Built with a NODE_TABLE_SIZE of 512 (Makefile).
+ */
+
+#include "node-table.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ROUNDS              4000000L
+
+/* Addresses sharing one bucket, see collide() */
+#define COLLIDE_COUNT             9
+
+static int failures;
+static clock_time_t ticks;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while(0)
+
+/*---------------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+  return ticks;
+}
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+/* fd00::212:4b00:xxxx:xxxx, a CC13xx style IID carrying i */
+static void
+make_addr(uip_ipaddr_t *addr, uint32_t i)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->u8[0] = 0xfd;
+  addr->u8[8] = 0x02;
+  addr->u8[9] = 0x12;
+  addr->u8[10] = 0x4b;
+  addr->u8[12] = (uint8_t)(i >> 24);
+  addr->u8[13] = (uint8_t)(i >> 16);
+  addr->u8[14] = (uint8_t)(i >> 8);
+  addr->u8[15] = (uint8_t)i;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The k-th of COLLIDE_COUNT addresses with the same IID hash: adding 1 to
+ * byte 14 and taking 31 off byte 15 leaves h * 31 + b unchanged, whatever
+ * the number of buckets.
+ */
+static void
+collide(uip_ipaddr_t *addr, int k)
+{
+  make_addr(addr, 0xa5000000UL);
+  addr->u8[14] = (uint8_t)k;
+  addr->u8[15] = (uint8_t)(255 - 31 * k);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_add_lookup(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *nodes[100];
+  uint32_t i;
+
+  node_table_init();
+  for(i = 0; i < 100; i++) {
+    make_addr(&addr, i * 7919);
+    nodes[i] = node_table_add(&addr, FARM_NODE_ENV);
+    CHECK(nodes[i] != NULL);
+  }
+  CHECK(node_table_count() == 100);
+
+  for(i = 0; i < 100; i++) {
+    make_addr(&addr, i * 7919);
+    CHECK(node_table_lookup(&addr) == nodes[i]);
+  }
+  make_addr(&addr, 1);
+  CHECK(node_table_lookup(&addr) == NULL);
+
+  /* Adding a known node only updates its class */
+  make_addr(&addr, 7919);
+  CHECK(node_table_add(&addr, FARM_NODE_PH) == nodes[1]);
+  CHECK(nodes[1]->node_class == FARM_NODE_PH);
+  CHECK(node_table_count() == 100);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_collisions(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *nodes[COLLIDE_COUNT];
+  int k;
+
+  node_table_init();
+  for(k = 0; k < COLLIDE_COUNT; k++) {
+    collide(&addr, k);
+    nodes[k] = node_table_add(&addr, FARM_NODE_WATER_TEMP);
+    CHECK(nodes[k] != NULL);
+  }
+  for(k = 0; k < COLLIDE_COUNT; k++) {
+    collide(&addr, k);
+    CHECK(node_table_lookup(&addr) == nodes[k]);
+  }
+
+  /* Unlink from the middle, the head (newest) and the tail of the chain */
+  node_table_remove(nodes[4]);
+  node_table_remove(nodes[COLLIDE_COUNT - 1]);
+  node_table_remove(nodes[0]);
+  CHECK(node_table_count() == COLLIDE_COUNT - 3);
+  for(k = 0; k < COLLIDE_COUNT; k++) {
+    collide(&addr, k);
+    if(k == 0 || k == 4 || k == COLLIDE_COUNT - 1) {
+      CHECK(node_table_lookup(&addr) == NULL);
+    } else {
+      CHECK(node_table_lookup(&addr) == nodes[k]);
+    }
+  }
+
+  /* The freed slots are used again */
+  collide(&addr, 4);
+  CHECK(node_table_add(&addr, FARM_NODE_WATER_TEMP) != NULL);
+  CHECK(node_table_count() == COLLIDE_COUNT - 2);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_full(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *first;
+  uint32_t i;
+
+  node_table_init();
+  for(i = 0; i < NODE_TABLE_SIZE; i++) {
+    make_addr(&addr, i);
+    CHECK(node_table_add(&addr, FARM_NODE_EC) != NULL);
+  }
+  CHECK(node_table_count() == NODE_TABLE_SIZE);
+  CHECK(node_table_overflows() == 0);
+
+  /* A new node is refused, the known ones stay */
+  make_addr(&addr, NODE_TABLE_SIZE);
+  CHECK(node_table_add(&addr, FARM_NODE_EC) == NULL);
+  CHECK(node_table_add(&addr, FARM_NODE_EC) == NULL);
+  CHECK(node_table_overflows() == 2);
+  for(i = 0; i < NODE_TABLE_SIZE; i++) {
+    make_addr(&addr, i);
+    if(node_table_lookup(&addr) == NULL) {
+      printf("node %lu lost from a full table\n", (unsigned long)i);
+      failures++;
+    }
+  }
+
+  /* A known node is still found by add */
+  make_addr(&addr, 0);
+  first = node_table_add(&addr, FARM_NODE_EC);
+  CHECK(first != NULL);
+  CHECK(node_table_overflows() == 2);
+
+  /* Removing one makes room for exactly one */
+  node_table_remove(first);
+  make_addr(&addr, NODE_TABLE_SIZE);
+  CHECK(node_table_add(&addr, FARM_NODE_EC) != NULL);
+  make_addr(&addr, NODE_TABLE_SIZE + 1);
+  CHECK(node_table_add(&addr, FARM_NODE_EC) == NULL);
+  CHECK(node_table_count() == NODE_TABLE_SIZE);
+  CHECK(node_table_overflows() == 3);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_iterate(void)
+{
+  static uint8_t seen[NODE_TABLE_SIZE];
+  uip_ipaddr_t addr;
+  farm_node_t *n;
+  uint32_t i;
+  int visited = 0;
+
+  node_table_init();
+  for(i = 0; i < NODE_TABLE_SIZE; i += 3) {
+    make_addr(&addr, i);
+    node_table_add(&addr, FARM_NODE_ENV);
+  }
+  collide(&addr, 1);
+  node_table_add(&addr, FARM_NODE_ENV);
+  collide(&addr, 2);
+  node_table_add(&addr, FARM_NODE_ENV);
+
+  memset(seen, 0, sizeof(seen));
+  for(n = node_table_head(); n != NULL; n = node_table_next(n)) {
+    visited++;
+    if(n->addr.u8[12] == 0xa5) {
+      continue;
+    }
+    i = (uint32_t)n->addr.u8[14] << 8 | n->addr.u8[15];
+    CHECK(i < NODE_TABLE_SIZE && i % 3 == 0 && !seen[i]);
+    if(i < NODE_TABLE_SIZE) {
+      seen[i] = 1;
+    }
+  }
+  CHECK(visited == node_table_count());
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_channels(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *n;
+  node_channel_t *ch;
+  int i;
+
+  node_table_init();
+  make_addr(&addr, 42);
+  n = node_table_add(&addr, FARM_NODE_WATER_TEMP);
+
+  for(i = 0; i < NODE_TABLE_CHANNELS; i++) {
+    CHECK(node_table_update(n, FARM_TLV_WATER_TEMP, i, 1800 + i) != NULL);
+  }
+  /* No slot left for another probe, the known ones still update */
+  CHECK(node_table_update(n, FARM_TLV_WATER_TEMP, NODE_TABLE_CHANNELS,
+                          1) == NULL);
+  CHECK(node_table_channel(n, FARM_TLV_WATER_TEMP,
+                           NODE_TABLE_CHANNELS) == NULL);
+
+  ticks = 1000;
+  ch = node_table_update(n, FARM_TLV_WATER_TEMP, 3, 2000);
+  CHECK(ch != NULL);
+  CHECK(ch == node_table_channel(n, FARM_TLV_WATER_TEMP, 3));
+  CHECK(ch->value == 2000 && ch->samples == 2 && ch->updated == 1000);
+  CHECK(node_table_channel(n, FARM_TLV_WATER_TEMP, 4)->value == 1804);
+  CHECK(node_table_channel(n, FARM_TLV_TEMPERATURE, 0) == NULL);
+  CHECK(n->channel_count == NODE_TABLE_CHANNELS);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_channel_pool(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *n = NULL;
+  farm_node_t *full;
+  uint32_t node;
+  int taken = 0;
+  int i;
+
+  /* Nodes with every channel they may hold, until the pool runs dry */
+  node_table_init();
+  for(node = 0; node_table_channel_overflows() == 0; node++) {
+    make_addr(&addr, node);
+    n = node_table_add(&addr, FARM_NODE_ENV);
+    CHECK(n != NULL);
+    for(i = 0; i < NODE_TABLE_CHANNELS; i++) {
+      if(node_table_update(n, FARM_TLV_LIGHT, i, i) == NULL) {
+        break;
+      }
+      taken++;
+    }
+  }
+  CHECK(taken == NODE_TABLE_CHANNEL_POOL);
+  CHECK(node_table_channel_overflows() == 1);
+
+  /* A removed node gives its channels back */
+  full = n;
+  make_addr(&addr, 0);
+  node_table_remove(node_table_lookup(&addr));
+  for(i = 0; i < NODE_TABLE_CHANNELS; i++) {
+    if(node_table_update(full, FARM_TLV_TEMPERATURE, i, i) == NULL) {
+      break;
+    }
+  }
+  CHECK(full->channel_count == NODE_TABLE_CHANNELS);
+  CHECK(node_table_channel_overflows() == 1);
+}
+/*---------------------------------------------------------------------------*/
+static int
+count_of(uint8_t type)
+{
+  node_channel_t *ch;
+  int n = 0;
+
+  for(ch = node_table_first_of(type); ch != NULL; ch = ch->type_next) {
+    CHECK(ch->type == type);
+    n++;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_by_type(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *n;
+  uint32_t node;
+
+  /* Many nodes, few of them with the channel a rule reads */
+  node_table_init();
+  for(node = 0; node < 100; node++) {
+    make_addr(&addr, node);
+    n = node_table_add(&addr, FARM_NODE_ENV);
+    node_table_update(n, FARM_TLV_TEMPERATURE, 0, 2000);
+    if(node % 10 == 0) {
+      node_table_update(n, FARM_TLV_FLOAT_SWITCH, 0, 1);
+      node_table_update(n, FARM_TLV_FLOAT_SWITCH, 0, 0);
+    }
+  }
+  CHECK(count_of(FARM_TLV_TEMPERATURE) == 100);
+  CHECK(count_of(FARM_TLV_FLOAT_SWITCH) == 10);
+  CHECK(count_of(FARM_TLV_LIGHT) == 0);
+  CHECK(node_table_first_of(FARM_TLV_MEAN(FARM_TLV_TEMPERATURE)) == NULL);
+
+  /* A removed node leaves the chains of its types */
+  make_addr(&addr, 50);
+  node_table_remove(node_table_lookup(&addr));
+  CHECK(count_of(FARM_TLV_TEMPERATURE) == 99);
+  CHECK(count_of(FARM_TLV_FLOAT_SWITCH) == 9);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_energy(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *nodes[NODE_TABLE_ENERGY_SIZE + 1];
+  node_energy_t *e;
+  int i;
+
+  node_table_init();
+  for(i = 0; i <= NODE_TABLE_ENERGY_SIZE; i++) {
+    make_addr(&addr, 1000 + i);
+    nodes[i] = node_table_add(&addr, FARM_NODE_EC);
+    CHECK(nodes[i]->energy == NULL);
+  }
+  for(i = 0; i < NODE_TABLE_ENERGY_SIZE; i++) {
+    e = node_table_energy(nodes[i]);
+    CHECK(e != NULL && e->sum[0] == 0);
+    if(e != NULL) {
+      e->sum[0] += 15 * FARM_ENERGY_SECOND;
+    }
+    CHECK(node_table_energy(nodes[i]) == e);
+  }
+  /* The table is full, the node is still served otherwise */
+  CHECK(node_table_energy(nodes[NODE_TABLE_ENERGY_SIZE]) == NULL);
+
+  node_table_remove(nodes[0]);
+  e = node_table_energy(nodes[NODE_TABLE_ENERGY_SIZE]);
+  CHECK(e != NULL && e->sum[0] == 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_seq(void)
+{
+  uip_ipaddr_t addr;
+  farm_node_t *n;
+  uint32_t received;
+
+  node_table_init();
+  make_addr(&addr, 7);
+  n = node_table_add(&addr, FARM_NODE_ENV);
+
+  CHECK(node_table_seq(n, 10, 2) == 1);
+  CHECK(node_table_seq(n, 10, 2) == 0);
+  CHECK(node_table_seq(n, 13, 2) == 1);
+  CHECK(n->seq_lost == 2);
+  CHECK(node_table_seq(n, 11, 2) == 1);     /* Late, not lost after all */
+  CHECK(node_table_seq(n, 11, 2) == 0);
+  CHECK(n->seq == 13 && n->seq_lost == 1);
+  CHECK(n->seq_received == 3 && n->seq_duplicates == 2);
+
+  /* 12 is missing: ack 11, and 13 arrived */
+  CHECK(node_table_seq_ack(n, &received) == 11);
+  CHECK(received == 0x2);
+  CHECK(node_table_seq(n, 12, -1) == 1);
+  CHECK(node_table_seq_ack(n, &received) == 13 && received == 0);
+
+  /* A new boot count restarts the count even though 5 looks like a
+     frame already received */
+  CHECK(node_table_seq(n, 5, 3) == 1);
+  CHECK(n->seq == 5 && n->boot == 3 && n->seq_lost == 0);
+  CHECK(node_table_seq(n, 5, 3) == 0);
+
+  /* With an unchanged boot count seq 0 is an ordinary frame */
+  CHECK(node_table_seq(n, 0, 4) == 1 && n->boot == 4);
+  CHECK(node_table_seq(n, 1, 4) == 1);
+  CHECK(node_table_seq(n, 0, 4) == 0);
+  CHECK(n->seq == 1);
+
+  /* Without a boot count, seq 0 and a jump far back also restart */
+  CHECK(node_table_seq(n, 0, -1) == 1 && n->seq == 0);
+  CHECK(node_table_seq(n, 100, -1) == 1);
+  CHECK(node_table_seq(n, 100 - NODE_TABLE_SEQ_WINDOW, -1) == 1);
+  CHECK(n->seq == 100 - NODE_TABLE_SEQ_WINDOW);
+
+  /* Across the 16-bit wrap */
+  CHECK(node_table_seq(n, 65534, 3) == 1);
+  CHECK(node_table_seq(n, 1, 3) == 1);
+  CHECK(n->seq == 1 && n->seq_lost == 99 + 2);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_fill(int fill)
+{
+  static uip_ipaddr_t addrs[NODE_TABLE_SIZE];
+  volatile uintptr_t sink = 0;
+  farm_node_t *n;
+  double start;
+  double lookup;
+  double update;
+  long i;
+  int j;
+
+  node_table_init();
+  for(j = 0; j < fill; j++) {
+    make_addr(&addrs[j], 0x1000 + j * 2654435761UL);
+    node_table_add(&addrs[j], FARM_NODE_ENV);
+  }
+
+  start = now();
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    sink += (uintptr_t)node_table_lookup(&addrs[i % fill]);
+  }
+  lookup = (now() - start) * 1e9 / BENCH_ROUNDS;
+
+  /* What the border router does per telemetry record */
+  start = now();
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    n = node_table_lookup(&addrs[i % fill]);
+    sink += (uintptr_t)node_table_update(n, FARM_TLV_TEMPERATURE, 0, i);
+  }
+  update = (now() - start) * 1e9 / BENCH_ROUNDS;
+
+  printf("  %4d nodes    lookup %5.1f ns, lookup + update %5.1f ns\n",
+         fill, lookup, update);
+}
+/*---------------------------------------------------------------------------*/
+static void
+benchmark(void)
+{
+  uip_ipaddr_t addr;
+  volatile uintptr_t sink = 0;
+  double start;
+  long i;
+
+  printf("\nNode table, %d buckets, %ld rounds:\n",
+         NODE_TABLE_BUCKETS, BENCH_ROUNDS);
+  bench_fill(8);
+  bench_fill(64);
+  bench_fill(NODE_TABLE_SIZE);
+
+  /* Worst case: the oldest of COLLIDE_COUNT nodes in one chain */
+  node_table_init();
+  for(i = 0; i < COLLIDE_COUNT; i++) {
+    collide(&addr, i);
+    node_table_add(&addr, FARM_NODE_ENV);
+  }
+  collide(&addr, 0);
+  start = now();
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    sink += (uintptr_t)node_table_lookup(&addr);
+  }
+  printf("  chain of %d   lookup %5.1f ns\n", COLLIDE_COUNT,
+         (now() - start) * 1e9 / BENCH_ROUNDS);
+
+  printf("\nRAM on this host, each with its 1 B pool count:\n");
+  printf("  node entry %u B + %u B of bucket pointers\n",
+         (unsigned)sizeof(farm_node_t) + 1,
+         (unsigned)(NODE_TABLE_BUCKETS * sizeof(farm_node_t *)
+                    / NODE_TABLE_SIZE));
+  printf("  channel %u B, from a pool of %u\n",
+         (unsigned)sizeof(node_channel_t) + 1, NODE_TABLE_CHANNEL_POOL);
+  printf("  energy sums %u B, for %u nodes\n",
+         (unsigned)sizeof(node_energy_t) + 1, NODE_TABLE_ENERGY_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char *argv[])
+{
+  test_add_lookup();
+  test_collisions();
+  test_full();
+  test_iterate();
+  test_channels();
+  test_channel_pool();
+  test_by_type();
+  test_energy();
+  test_seq();
+
+  if(failures > 0) {
+    printf("node-table: %d checks failed\n", failures);
+    return 1;
+  }
+  printf("node-table: all checks passed\n");
+
+  if(argc < 2 || strcmp(argv[1], "-q") != 0) {
+    benchmark();
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/